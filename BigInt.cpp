@@ -30,100 +30,559 @@
  * 
  */
 
+#include <math.h>
 #include <string.h>
 #include "BigInt.h"
+#include "BigIntKernels.h"
+#include "FixedBigInt.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// ECM spreads its curves over as many threads as there are processors,
+// where there are POSIX threads to do it with.
+//
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_PTHREAD 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Reference counts on shared digits.  Copies may be made from the same
+// value on several threads at once, so the counts are atomic where the
+// compiler lets us.
+//
+#if defined(__GNUC__) || defined(__clang__)
+#define REFS_ADD(refs, n) __atomic_add_fetch(refs, n, __ATOMIC_ACQ_REL)
+#define REFS_LOAD(refs) __atomic_load_n(refs, __ATOMIC_ACQUIRE)
+#else
+#define REFS_ADD(refs, n) (*(refs) += (n))
+#define REFS_LOAD(refs) (*(refs))
+#endif
 
 #define USESQUAREMOD 0
 #define USESQUARE 0
 
+// Operands with at least this many significant digits are multiplied by
+// packing them into 64-bit limbs and handing them to the arithmetic
+// kernels; smaller ones are cheaper to do digit-by-digit in place.
+#define KERNELDIGITS (LIMBBITS/DIGITBITS)
+
+// expmod_many() leaves moduli bigger than this to expmod(), as the lane
+// kernels' column sums would overflow.
+#define LANEMAXBITS 16384
+
+// Moduli of up to this many limbs are multiplied with FixedBigInt's
+// unrolled Montgomery multiplication, which beats all the kernels there.
+#define FIXEDMONTLIMBS 4
+
+static void (*const fixed_montmul[FIXEDMONTLIMBS+1])(LIMB*, const LIMB*, const LIMB*,
+													  const LIMB*, long, LIMB) =
+{
+	NULL,
+	FixedBigInt<64>::montmul_limbs,
+	FixedBigInt<128>::montmul_limbs,
+	FixedBigInt<192>::montmul_limbs,
+	FixedBigInt<256>::montmul_limbs,
+};
+
+// FixedBigInt's constant arithmetic is checked at compile time, so the
+// header can't quietly stop being usable in constants.  The checks are in
+// a header of their own, as older compilers can't even skip over digit
+// separators.
+//
+#if __cplusplus >= 201402L
+#include "FixedBigIntChecks.h"
+#endif
+
+// Words for the single-word arithmetic are 32 bits, so that a digit times
+// a word plus a word always fits in 64 bits.
+#define WORDBITS 32
+#define WORDDIGITS ((WORDBITS + DIGITBITS - 1) / DIGITBITS)
+
+// If the magnitude of value fits in a word, store it in *word and return
+// true, so the caller can use the single-word arithmetic.
+//
+static bool small_long(long value, uint32_t* word)
+{
+	unsigned long magnitude = (value < 0) ? 0UL - (unsigned long)value : (unsigned long)value;
+	*word = (uint32_t)magnitude;
+	return magnitude == *word;
+}
+
+// The odd primes below 1000, for trial division.
+//
+static const uint16_t small_primes[] = {
+	3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47,
+	53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109,
+	113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191,
+	193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251, 257, 263, 269,
+	271, 277, 281, 283, 293, 307, 311, 313, 317, 331, 337, 347, 349, 353,
+	359, 367, 373, 379, 383, 389, 397, 401, 409, 419, 421, 431, 433, 439,
+	443, 449, 457, 461, 463, 467, 479, 487, 491, 499, 503, 509, 521, 523,
+	541, 547, 557, 563, 569, 571, 577, 587, 593, 599, 601, 607, 613, 617,
+	619, 631, 641, 643, 647, 653, 659, 661, 673, 677, 683, 691, 701, 709,
+	719, 727, 733, 739, 743, 751, 757, 761, 769, 773, 787, 797, 809, 811,
+	821, 823, 827, 829, 839, 853, 857, 859, 863, 877, 881, 883, 887, 907,
+	911, 919, 929, 937, 941, 947, 953, 967, 971, 977, 983, 991, 997
+};
+#define SMALLPRIMES ((long)(sizeof(small_primes) / sizeof(small_primes[0])))
+
+// The Jacobi symbol (a/n), for odd n.
+//
+static int jacobi_word(uint64_t a, uint64_t n)
+{
+	int result = 1;
+	a %= n;
+	while (a)
+	{
+		while (!(a & 1))
+		{
+			a >>= 1;
+			if ((n & 7) == 3 || (n & 7) == 5)
+				result = -result;
+		}
+		uint64_t t = a;
+		a = n;
+		n = t;
+		if ((a & 3) == 3 && (n & 3) == 3)
+			result = -result;
+		a %= n;
+	}
+	return n == 1 ? result : 0;
+}
+
+// Fill the buffer from the file opened as context, for random_prime().
+//
+static bool read_random(void* context, unsigned char* buffer, long length)
+{
+	return fread(buffer, 1, length, (FILE*)context) == (size_t)length;
+}
+
+// Bit counts of a single digit, widened to an unsigned long.  The
+// compiler's builtins are single instructions on most machines; elsewhere
+// we loop.
+//
+static inline int bit_length(unsigned long x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return x ? (int)(sizeof(unsigned long)*8) - __builtin_clzl(x) : 0;
+#else
+	int n = 0;
+	for (; x; x>>=1)
+		++n;
+	return n;
+#endif
+}
+
+// x must not be zero.
+static inline int trailing_zeros(unsigned long x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzl(x);
+#else
+	int n = 0;
+	for (; !(x & 1); x>>=1)
+		++n;
+	return n;
+#endif
+}
+
+static inline int ones(unsigned long x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountl(x);
+#else
+	int n = 0;
+	for (; x; x&=x-1)
+		++n;
+	return n;
+#endif
+}
+
+// Returns true if n is prime, by trial division; for the small numbers
+// (exponents, and moduli of a word) the root tests need.
+//
+static bool small_prime(uint64_t n)
+{
+	if (n < 4)
+		return n >= 2;
+	if (!(n & 1))
+		return false;
+	for (uint64_t d=3; d*d<=n; d+=2)
+		if (n % d == 0)
+			return false;
+	return true;
+}
+
+// Negate the n limbs at r as a two's complement number, in place.
+//
+static void negate_limbs(LIMB* r, long n)
+{
+	LIMB carry = 1;
+	for (long k=0; k<n; k++)
+	{
+		r[k] = ~r[k] + carry;
+		carry = carry && !r[k];
+	}
+}
+
+// String conversion works on limbs in base B = base^d, the biggest power
+// of the base that fits in one (10^19 for decimal).  Longer numbers are
+// split at B, B^2, B^4 and so on (squaring each time) until the pieces
+// are small enough to do a limb at a time; with the fast multiply and
+// divide underneath, that's subquadratic in both directions.  Power-of-
+// two bases don't need any of that: their digits are just slices of
+// bits.
+//
+// Pieces of fewer limbs than this are done a limb at a time.
+#define RADIXLIMBS 30
+
+struct Radix
+{
+	int base;
+	int digits;					// d, the base's digits in a limb
+	LIMB chunk;					// B = base^d
+	int bits;					// bits per digit, for powers of two
+	int levels;					// how many of the powers have been made
+	LIMB* powers[LIMBBITS];		// powers[k] = B^(2^k), plen[k] limbs long
+	long plen[LIMBBITS];
+};
+
+static void radix_init(Radix* radix, int base)
+{
+	radix->base = base;
+	radix->digits = 1;
+	radix->chunk = base;
+	while (radix->chunk <= ~(LIMB)0 / base)
+	{
+		radix->chunk *= base;
+		radix->digits++;
+	}
+	radix->bits = 0;
+	if (!(base & (base-1)))
+		while ((1 << radix->bits) < base)
+			radix->bits++;
+	radix->levels = 0;
+}
+
+// Make powers[k] for every k with d*2^k < digits, returning the last k (-1
+// if there are none).  They're made afresh for each conversion, which
+// costs less than the conversion itself and keeps it thread-safe.
+//
+static int radix_powers(Radix* radix, long digits)
+{
+	LIMB** powers = radix->powers;
+	long* plen = radix->plen;
+	int k = -1;
+	for (long d=radix->digits; d<digits; d*=2)
+	{
+		++k;
+		if (k == 0)
+		{
+			powers[0] = new LIMB[1];
+			powers[0][0] = radix->chunk;
+			plen[0] = 1;
+			continue;
+		}
+		powers[k] = new LIMB[2*plen[k-1]];
+		bigint_sqr(powers[k], powers[k-1], plen[k-1]);
+		plen[k] = 2*plen[k-1];
+		if (!powers[k][plen[k]-1])
+			--plen[k];
+	}
+	radix->levels = k+1;
+	return k;
+}
+
+static void radix_free(Radix* radix)
+{
+	for (int k=0; k<radix->levels; k++)
+		delete[] radix->powers[k];
+	radix->levels = 0;
+}
+
+// The value of the digit c in bases up to 36, or 36 if it isn't one.
+//
+static inline int digit_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 10;
+	return 36;
+}
+
+// The 8 characters at s packed into a word, the first in the low byte.
+//
+static inline uint64_t eight_chars(const char* s)
+{
+	uint64_t v = 0;
+	for (int i=0; i<8; i++)
+		v |= (uint64_t)(unsigned char)s[i] << (8*i);
+	return v;
+}
+
+// The value of the 8 decimal digits at s, converted all at once: adjacent
+// digits are paired up, then pairs of pairs, then pairs of those.
+//
+static inline uint64_t eight_digits(const char* s)
+{
+	uint64_t v = eight_chars(s) - 0x3030303030303030ULL;
+	v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFULL;
+	v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFFULL;
+	return (v * 10000 + (v >> 32)) & 0xFFFFFFFFULL;
+}
+
+// Returns true if all len characters at s are digits in the base.
+// Decimal digits are checked eight at a time: each byte must be 0x30 to
+// 0x39, so its high nibble is 3 and stays 3 when 6 is added to the low
+// one.
+//
+static bool radix_valid(const char* s, long len, int base)
+{
+	long i = 0;
+	if (base == 10)
+		for ( ; i+8<=len; i+=8)
+		{
+			uint64_t v = eight_chars(&s[i]);
+			if ((v & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL ||
+				((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL)
+				return false;
+		}
+	for ( ; i<len; i++)
+		if (digit_value(s[i]) >= base)
+			return false;
+	return true;
+}
+
+// The value of the len (at most d) digits at s.
+//
+static LIMB radix_chunk(const char* s, long len, int base)
+{
+	LIMB v = 0;
+	if (base == 10)
+		for ( ; len >= 8; s += 8, len -= 8)
+			v = v * 100000000 + eight_digits(s);
+	for ( ; len > 0; s++, len--)
+		v = v * base + digit_value(*s);
+	return v;
+}
+
+// Set r to the value of the len digits at s, returning the number of
+// limbs used.  r needs room for len/d+3 limbs.  The powers must have been
+// made up to at least the last k with d*2^k < len.
+//
+static long radix_to_limbs(LIMB* r, const char* s, long len, const Radix* radix, int k)
+{
+	int d = radix->digits;
+	while (k >= 0 && ((long)d << k) >= len)
+		--k;
+
+	if (k < 0 || len <= RADIXLIMBS*d)
+	{
+		// A limb's worth of digits at a time, from the top: r = r*B +
+		// chunk, with the chunk put in first and the product added on
+		//
+		LIMB t[RADIXLIMBS+2];
+		long head = len % d;
+		if (!head)
+			head = d;
+		r[0] = radix_chunk(s, head, radix->base);
+		long n = 1;
+		for (s += head, len -= head; len > 0; s += d, len -= d)
+		{
+			t[0] = radix_chunk(s, d, radix->base);
+			memset(&t[1], 0, n*LIMBBYTES);
+			t[n] = bigint_kernels()->addmul_1(t, r, n, radix->chunk);
+			n += (t[n] != 0);
+			memcpy(r, t, n*LIMBBYTES);
+		}
+		return n;
+	}
+
+	// Split off the bottom d*2^k digits: r = top * powers[k] + bottom
+	//
+	long lowlen = (long)d << k;
+	long toproom = (len-lowlen)/d + 3;
+	LIMB* top = new LIMB[toproom + lowlen/d + 3];
+	LIMB* bottom = &top[toproom];
+	long tn = radix_to_limbs(top, s, len-lowlen, radix, k-1);
+	long bn = radix_to_limbs(bottom, &s[len-lowlen], lowlen, radix, k-1);
+
+	long n = tn + radix->plen[k];
+	bigint_mul(r, top, tn, radix->powers[k], radix->plen[k]);
+	LIMB carry = 0;
+	for (long i=0; i<n && (i<bn || carry); i++)
+	{
+		LIMB sum = r[i] + carry;
+		carry = (sum < carry);
+		if (i < bn)
+		{
+			sum += bottom[i];
+			carry += (sum < bottom[i]);
+		}
+		r[i] = sum;
+	}
+	delete[] top;
+	while (n > 1 && !r[n-1])
+		--n;
+	return n;
+}
+
+// Set r to the value of the len digits at s in a power-of-two base,
+// returning the number of limbs used.  r needs room for len*bits/64+1
+// limbs.
+//
+static long bits_to_limbs(LIMB* r, const char* s, long len, int bits)
+{
+	long n = (len*bits + LIMBBITS-1) / LIMBBITS;
+	memset(r, 0, n*LIMBBYTES);
+	long pos = 0;
+	for (long i=len-1; i>=0; i--, pos+=bits)
+	{
+		LIMB v = digit_value(s[i]);
+		r[pos/LIMBBITS] |= v << (pos%LIMBBITS);
+		if (pos%LIMBBITS + bits > LIMBBITS)
+			r[pos/LIMBBITS+1] |= v >> (LIMBBITS - pos%LIMBBITS);
+	}
+	while (n > 1 && !r[n-1])
+		--n;
+	return n;
+}
+
 // Constructors & destructors
 
-BigInt::BigInt()
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt()
 {
 	this->value = NULL;
+	this->refs = NULL;
+	this->decimal = NULL;
 	set_zero();
 }
 
-BigInt::BigInt(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(const BasicBigInt& bi)
 {
 	this->value = NULL;
-	copy_value(bi.value, bi.lsd+1, bi.negative);
+	this->refs = NULL;
+	this->decimal = NULL;
+	share(bi);
 }
 
-BigInt::BigInt(unsigned char* value, long count)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(unsigned char* value, long count)
 {
 	this->value = NULL;
+	this->refs = NULL;
+	this->decimal = NULL;
 	copy_bytes(value, count, false);	// default to positive
 }
 
-BigInt::BigInt(unsigned char* value, long count, bool negative)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(unsigned char* value, long count, bool negative)
 {
 	this->value = NULL;
+	this->refs = NULL;
+	this->decimal = NULL;
 	copy_bytes(value, count, negative);
 }
 
-BigInt::BigInt(long value)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(long value)
 {
 	this->value = NULL;
+	this->refs = NULL;
+	this->decimal = NULL;
 	set_value(value);
 }
 
-BigInt::BigInt(const char* value)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(const char* value)
 {
 	this->value = NULL;
+	this->refs = NULL;
+	this->decimal = NULL;
 	set_value(value);
 }
 
-BigInt::BigInt(const unsigned char* value)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(const unsigned char* value)
 {
 	this->value = NULL;
+	this->refs = NULL;
+	this->decimal = NULL;
 	set_value(value);
 }
 
-BigInt::BigInt(long count, DIGIT value)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(long count, DIGIT value)
 {
 	this->value = new DIGIT[count];
+	this->refs = NULL;
+	this->decimal = NULL;
 	msd = lsd = count-1;
 	memset(this->value, value, count*DIGITBYTES);
 	negative = false;
 }
 
-BigInt::BigInt(TWODIGITS_CONSTYPE digits)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::BasicBigInt(unsigned long digits)
 {
 	this->value = NULL;
-	set_value((TWODIGITS_CONSTYPE)digits);
+	this->refs = NULL;
+	this->decimal = NULL;
+	set_value(digits);
 }
 
 
-BigInt::~BigInt()
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>::~BasicBigInt()
 {
-	if (value)
-	{
-		delete[] value;
-		value = NULL;
-	}
+	release();
+	uncache();
 }
 
 
 
 // Assignment
 
-bool BigInt::operator=(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator=(const BasicBigInt& bi)
 {
-	return copy_value(bi.value, bi.lsd+1, bi.negative);
+	uncache();
+	if (this != &bi)
+	{
+		release();
+		share(bi);
+	}
+	return true;
 }
 
-bool BigInt::operator=(const long value)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator=(const long value)
 {
+	uncache();
 	return set_value(value);
 }
 
-bool BigInt::operator=(char* value)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator=(const char* value)
 {
+	uncache();
 	return set_value(value);
 }
 
-bool BigInt::copy_value(DIGIT* value, long count)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::copy_value(DIGIT* value, long count)
 {
 	return copy_value(value, count, false);	// default to positive
 }
@@ -133,19 +592,14 @@ bool BigInt::copy_value(DIGIT* value, long count)
 //
 // c.f. use_value
 //
-bool BigInt::copy_value(DIGIT* value, long count, bool negative)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::copy_value(DIGIT* value, long count, bool negative)
 {
 	if (!value)  return false;
 	if (!count)  return set_zero();
 
-	if (this->value)
-	{
-		if (lsd+1 < count)
-		{
-			delete[] this->value;
-			this->value = NULL;
-		}
-	}
+	if (this->value && (refs || lsd+1 < count))
+		release();
 
 	if (!this->value)
 	{	
@@ -162,27 +616,25 @@ bool BigInt::copy_value(DIGIT* value, long count, bool negative)
 	return true;
 }
 
-bool BigInt::copy_bytes(const unsigned char* value, long count)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::copy_bytes(const unsigned char* value, long count)
 {
+	uncache();
 	return copy_bytes(value, count, false);	// default to positive
 }
 
-bool BigInt::copy_bytes(const unsigned char* value, long count, bool negative)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::copy_bytes(const unsigned char* value, long count, bool negative)
 {
+	uncache();
 	if (!value)  return false;
 	if (!count)  return set_zero();
 
 	unsigned char slop = (unsigned char) (count % DIGITBYTES);
 	long digits = count / DIGITBYTES + (slop ? 1 : 0);
 
-	if (this->value)
-	{
-		if (lsd+1 < digits)
-		{
-			delete[] this->value;
-			this->value = NULL;
-		}
-	}
+	if (this->value && (refs || lsd+1 < digits))
+		release();
 
 	if (!this->value)
 	{	
@@ -210,8 +662,38 @@ bool BigInt::copy_bytes(const unsigned char* value, long count, bool negative)
 	return true;
 }
 
-bool BigInt::use_value(DIGIT* value, long count)
+// Set the value from count big-endian bytes of two's complement: if the
+// top bit is set, the value is negative.  The bytes are read in place.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::copy_signed_bytes(const unsigned char* value, long count)
+{
+	uncache();
+	if (!copy_bytes(value, count, false))
+		return false;
+	if (!count || !(value[0] & 0x80))
+		return true;
+
+	// Negate the count*8 bits we just read to get the magnitude: flip
+	// them (no further than the top byte) and add one
+	//
+	long digits = count / DIGITBYTES + (count % DIGITBYTES ? 1 : 0);
+	long top = lsd+1-digits;
+	for (long i=top; i<=lsd; i++)
+		this->value[i] = ~this->value[i];
+	if (count % DIGITBYTES)
+		this->value[top] &= ((DIGIT)1 << (8*(count % DIGITBYTES))) - 1;
+	for (long i=lsd; i>=top && !++this->value[i]; i--);
+
+	for (msd=top; msd<lsd && this->value[msd]==0; msd++);
+	this->negative = true;
+	return true;
+}
+
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::use_value(DIGIT* value, long count)
 {
+	uncache();
 	return use_value(value, count, false);	// default to positive
 }
 
@@ -220,12 +702,13 @@ bool BigInt::use_value(DIGIT* value, long count)
 //
 // c.f. copy_value
 //
-bool BigInt::use_value(DIGIT* value, long count, bool negative)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::use_value(DIGIT* value, long count, bool negative)
 {
+	uncache();
 	if (!value) return false;
-	if (this->value)
-		delete[] this->value;
-	
+	release();
+
 	this->value = value;
 	this->lsd = count-1;
 	for (msd=0; msd<lsd && value[msd]==0; msd++);
@@ -233,67 +716,31 @@ bool BigInt::use_value(DIGIT* value, long count, bool negative)
 	return true;
 }
 
-bool BigInt::set_value(long value)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::set_value(long value)
 {
-	if (this->value)
-	{
-		delete[] this->value;
-		this->value = NULL;
-	}
-
-	if (!value)
-		return set_zero();
-	
-	// Get the sign
-	//
-	if (value < 0)
-	{
-		negative = true;
-		value *= -1;
-	}
-	else
-		negative = false;
-
-	// TODO: We're assuming that DIGITBYTES divides 4 evenly
-
-	lsd = 4 / DIGITBYTES - 1;
-	msd = lsd;
-	// Allocate and populate the digits
+	// Set the magnitude, then the sign
 	//
-	this->value = new DIGIT[lsd+1];
-	if (!this->value)  return false;
-	memset(this->value, 0, (lsd+1)*DIGITBYTES);
-	for (long i=lsd; value; i--)
-	{
-		this->value[i] = (DIGIT)(value & DIGITMASK);
-#if DIGITBITS == 32
-		value = 0;
-#else
-		value >>= DIGITBITS;
-#endif
-		if (this->value[i])
-			msd = i;
-	}
-	
+	unsigned long magnitude = (value < 0) ? 0UL - (unsigned long)value : (unsigned long)value;
+	if (!set_value(magnitude))
+		return false;
+	negative = (value < 0);
 	return true;
 }
 
-bool BigInt::set_value(unsigned long value)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::set_value(unsigned long value)
 {
-	if (this->value)
-	{
-		delete[] this->value;
-		this->value = NULL;
-	}
+	release();
 
 	if (!value)
 		return set_zero();
 	
 	negative = false;
 
-	// TODO: We're assuming that DIGITBYTES divides 4 evenly
+	// TODO: We're assuming that DIGITBYTES divides sizeof(long) evenly
 
-	this->lsd = 4 / DIGITBYTES - 1;
+	this->lsd = sizeof(unsigned long) / DIGITBYTES - 1;
 	this->msd = this->lsd;
 
 	// Allocate and populate the digits
@@ -304,12 +751,10 @@ bool BigInt::set_value(unsigned long value)
 	for (long i=this->lsd; value; i--)
 	{
 		this->value[i] = (DIGIT)(value & DIGITMASK);
-#if (DIGITBITS == 32)
-		// Can't >> or << by 32 bits; the compiler drops the instruction
-		value = 0;
-#else
-		value >>= DIGITBITS;
-#endif
+		// Shifting by the full width of a 32-bit long is undefined, so
+		// do it in two halves
+		value >>= DIGITBITS/2;
+		value >>= DIGITBITS/2;
 		if (this->value[i]) {
 			this->msd = i;
 		}
@@ -318,65 +763,87 @@ bool BigInt::set_value(unsigned long value)
 	return true;
 }
 
-bool BigInt::set_value(const char* value)
+// Set the value from an optional minus sign followed by decimal digits,
+// or by "0x" and hex digits.  Anything else is rejected, leaving zero.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::set_value(const char* value)
 {
-	if (!strcmp(value, "0"))
-		return set_zero();
+	bool minus = (value[0] == '-');
+	if (minus)
+		++value;
+
+	bool result;
+	if (value[0] == '0' && value[1] == 'x')
+		result = set_magnitude(&value[2], strlen(value)-2, 16);
+	else
+		result = set_magnitude(value, strlen(value), 10);
+	negative = minus && !zero();
+	return result;
+}
 
-	if (this->value)
+// Set the magnitude from the len digits at s in the given base, which
+// must be from 2 to 36, and make the value positive.  Letters stand for
+// digits from 10 up, in either case.  Returns false, leaving zero, if
+// there are no digits or any aren't in the base.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::set_magnitude(const char* s, long len, int base)
+{
+	if (!len || !radix_valid(s, len, base))
 	{
-		delete[] this->value;
-		this->value = NULL;
+		set_zero();
+		return false;
 	}
-	
-	// TODO: check the format (what if it's invalid?)
-	
-	set_zero();
 
-	// Get the sign
-	//
-	unsigned long i;
-	if (value[0] == '-')
+	Radix radix;
+	radix_init(&radix, base);
+	LIMB* limbs;
+	long n;
+	if (radix.bits)
 	{
-		negative = true;
-		i = 1;
+		limbs = new LIMB[len*radix.bits/LIMBBITS + 1];
+		n = bits_to_limbs(limbs, s, len, radix.bits);
 	}
 	else
 	{
-		negative = false;
-		i = 0;
+		int k = -1;
+		if (len > RADIXLIMBS*radix.digits)
+			k = radix_powers(&radix, len);
+		limbs = new LIMB[len/radix.digits + 3];
+		n = radix_to_limbs(limbs, s, len, &radix, k);
+		radix_free(&radix);
 	}
 
-	// Are we base 10 or base 16?
-	if (value[i] == '0' && value[i+1] == 'x') {
-		// Base 16.
-		i += 2;
-		for ( ; i < strlen(value); i++)
-		{
-			*this <<= 4;
-			unsigned long v = 
-				((value[i] >= '0' && value[i] <= '9') ? (value[i] - '0') :
-				 (value[i] >= 'a' && value[i] <= 'f') ? (value[i] - 'a' + 10) :
-				 (value[i] >= 'A' && value[i] <= 'F') ? (value[i] - 'A' + 10) :
-				 0);
-			add_digit(v);
-		}
+	bool result = from_limbs(limbs, n, false);
+	delete[] limbs;
+	return result;
+}
 
-		return true;
-	}
-	
-	// Get the magnitude
-	//
-	for ( ; i<strlen(value); i++)
+// Set the value from an optional minus sign followed by digits in the
+// given base, from 2 to 36.  Letters stand for digits from 10 up, in
+// either case.  Anything else is rejected, leaving zero.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::from_string(const char* value, int base)
+{
+	uncache();
+	if (base < 2 || base > 36)
 	{
-		*this *= (unsigned long)10;
-		add_digit(value[i]-'0');
+		set_zero();
+		return false;
 	}
 
-	return true;
+	bool minus = (value[0] == '-');
+	if (minus)
+		++value;
+	bool result = set_magnitude(value, strlen(value), base);
+	negative = minus && !zero();
+	return result;
 }
 
-bool BigInt::set_value(const unsigned char* val)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::set_value(const unsigned char* val)
 {
 	// A zero value is represented as four zero bytes for the length,
 	// and nothing else.
@@ -384,27 +851,15 @@ bool BigInt::set_value(const unsigned char* val)
 	if (val[0]==0 && val[1]==0 && val[2]==0 && val[3]==0)
 		return set_zero();
 
-	long bytes = (val[0]<<24) + (val[1]<<16) + (val[2]<<8) + val[3];
-
-	if (val[4] & 0x80)
-	{
-		unsigned char *bytecopy = new unsigned char[bytes];
-		memcpy(bytecopy, &val[4], bytes);
-		// TODO: This is ugly, but it should be OK
-		complement_bytes(bytecopy, bytes);
-		if (!copy_bytes(bytecopy, bytes, true)) {
-			delete[] bytecopy;
-			return false;
-		}
-		delete[] bytecopy;
-		return true;
-	}
-	else
-		return copy_bytes(&val[4], bytes, false);
+	long bytes = ((long)val[0]<<24) + (val[1]<<16) + (val[2]<<8) + val[3];
+	return copy_signed_bytes(&val[4], bytes);
 }
 
-bool BigInt::set_zero()
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::set_zero()
 {
+	if (refs)
+		release();
 	if (!value)
 	{
 		value = new DIGIT[1];
@@ -418,8 +873,11 @@ bool BigInt::set_zero()
 	return true;
 }
 
-void BigInt::set_high_bit()
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::set_high_bit()
 {
+	uncache();
+	unshare();
 	value[msd] |= DIGITHIGHBIT;
 }
 
@@ -431,8 +889,11 @@ void BigInt::set_high_bit()
 //
 //	++BigInt
 //
-const BigInt& BigInt::operator++()
+template <typename Digit, typename TwoDigits>
+const BasicBigInt<Digit, TwoDigits>& BasicBigInt<Digit, TwoDigits>::operator++()
 {
+	uncache();
+	unshare();
 	add_digit(1);
 	// TODO: what if this returns false?
 	return *this;
@@ -442,9 +903,12 @@ const BigInt& BigInt::operator++()
 //
 //	BigInt++
 //
-const BigInt BigInt::operator++(int dummy)
+template <typename Digit, typename TwoDigits>
+const BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator++(int dummy)
 {
-	BigInt tmp = *this;
+	uncache();
+	unshare();
+	BasicBigInt tmp = *this;
 	add_digit(1);
 	// TODO: what if this returns false?
 	return tmp;
@@ -454,23 +918,23 @@ const BigInt BigInt::operator++(int dummy)
 //
 //	BigInt + (anything from which a BigInt can be constructed)
 //
-BigInt BigInt::operator+(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator+(const BasicBigInt& bi) const
 {
-	BigInt result = *this;
+	BasicBigInt result = *this;
 	result += bi;
 	return result;
 }
 
 // This operator handles expressions of the form:
 //
-//	long + BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
+//	BigInt + long
 //
-BigInt operator+(long value, const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator+(long value) const
 {
-	BigInt result = value;
-	result += bi;
+	BasicBigInt result = *this;
+	result += value;
 	return result;
 }
 
@@ -478,8 +942,11 @@ BigInt operator+(long value, const BigInt& bi)
 //
 //	BigInt += (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator+=(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator+=(const BasicBigInt& bi)
 {
+	uncache();
+	unshare();
 	// If the signs match just add in the magnitude, since the sign 
 	// doesn't change.
 	// e.g. 3 + 5, 5 + 3, -3 + -5, -5 + -3
@@ -520,10 +987,72 @@ bool BigInt::operator+=(const BigInt& bi)
 	return false;	// never happens, just quieting the compiler
 }
 
+// This operator handles expressions of the form:
+//
+//	BigInt += long
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator+=(long value)
+{
+	uncache();
+	unshare();
+	uint32_t word;
+	if (!small_long(value, &word))
+		return *this += BasicBigInt(value);
+	return (value < 0) ? sub_word(word) : add_word(word);
+}
+
+// Add a single word to this value, without building a BigInt for it.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::add_word(uint32_t word)
+{
+	uncache();
+	unshare();
+	if (!negative)
+		return add_word_magnitude(word);
+
+	// -a + w: if the word is at least as big as a, the result is w - a
+	// and not negative
+	//
+	uint32_t magnitude;
+	if (word_value(&magnitude) && magnitude <= word)
+		return set_value((unsigned long)(word - magnitude));
+	subtract_word_magnitude(word);
+	return true;
+}
+
+// Add a word to the magnitude.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::add_word_magnitude(uint32_t word)
+{
+	unshare();
+	// Make sure there's room above msd for the carry to run into
+	//
+	if (msd < WORDDIGITS + 1 && !extend(WORDDIGITS + 1 - msd))
+		return false;
+
+	uint64_t carry = word;
+	long i;
+	for (i=lsd; carry; i--)
+	{
+		carry += value[i];
+		value[i] = (DIGIT)(carry & DIGITMASK);
+		carry >>= DIGITBITS;
+	}
+	if (i+1 < msd)
+		msd = i+1;
+
+	return true;
+}
+
 // Add in the given BigInt.
 //
-bool BigInt::add_BigInt(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::add_BigInt(const BasicBigInt& bi)
 {
+	unshare();
 	// Allocate more space if we think we might need some
 	//
 	long r_bilsd = bi.lsd-bi.msd;
@@ -558,7 +1087,8 @@ bool BigInt::add_BigInt(const BigInt& bi)
 		while (value[i] == DIGITMASK)
 			value[i--] = 0;
 		++value[i];
-		msd = i;
+		if (i < msd)
+			msd = i;
 	}
 	else if (i < msd)
 		msd = i+1;
@@ -568,8 +1098,10 @@ bool BigInt::add_BigInt(const BigInt& bi)
 
 // Add digit to current value.
 //
-bool BigInt::add_digit(DIGIT digit)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::add_digit(DIGIT digit)
 {
+	unshare();
 	TWODIGITS sum = (TWODIGITS)value[lsd] + (TWODIGITS)digit;
 	value[lsd] = (DIGIT)(sum & (TWODIGITS)DIGITMASK);
 	if (sum >> DIGITBITS)
@@ -583,8 +1115,8 @@ bool BigInt::add_digit(DIGIT digit)
 		for (i=lsd-1; i>=0 && value[i]==DIGITMASK; i--)
 			value[i] = 0;
 		++value[i];
-		if (!value[msd])
-			--msd;
+		if (i < msd)
+			msd = i;
 	}
 
 	return true;
@@ -598,8 +1130,11 @@ bool BigInt::add_digit(DIGIT digit)
 //
 //	--BigInt
 //
-const BigInt& BigInt::operator--()
+template <typename Digit, typename TwoDigits>
+const BasicBigInt<Digit, TwoDigits>& BasicBigInt<Digit, TwoDigits>::operator--()
 {
+	uncache();
+	unshare();
 	subtract_digit(1);
 	// TODO: what if this returns false?
 	return *this;
@@ -609,9 +1144,12 @@ const BigInt& BigInt::operator--()
 //
 //	BigInt--
 //
-const BigInt BigInt::operator--(int dummy)
+template <typename Digit, typename TwoDigits>
+const BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator--(int dummy)
 {
-	BigInt tmp = *this;
+	uncache();
+	unshare();
+	BasicBigInt tmp = *this;
 	subtract_digit(1);
 	// TODO: what if this returns false?
 	return tmp;
@@ -621,23 +1159,23 @@ const BigInt BigInt::operator--(int dummy)
 //
 //	BigInt - (anything from which a BigInt can be constructed)
 //
-BigInt BigInt::operator-(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator-(const BasicBigInt& bi) const
 {
-	BigInt result = *this;
+	BasicBigInt result = *this;
 	result -= bi;
 	return result;
 }
 
 // This operator handles expressions of the form:
 //
-//	long - BigInt
+//	BigInt - long
 //
-// NOTE: This function is not a method of this class, we're just friends
-//
-BigInt operator-(long value, const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator-(long value) const
 {
-	BigInt result = value;
-	result -= bi;
+	BasicBigInt result = *this;
+	result -= value;
 	return result;
 }
 
@@ -645,8 +1183,11 @@ BigInt operator-(long value, const BigInt& bi)
 //
 //	BigInt -= (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator-=(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator-=(const BasicBigInt& bi)
 {
+	uncache();
+	unshare();
 	// If the signs differ just add in the magnitude, since the sign 
 	// doesn't change.
 	// e.g. 3 - -5, 5 - -3, -3 - 5, -5 - 3
@@ -687,11 +1228,78 @@ bool BigInt::operator-=(const BigInt& bi)
 	return false;	// never happens, just quieting the compiler
 }
 
-// Subtract from the given BigInt.  We're assuming that its value is at
-// least as big as ours.
+// This operator handles expressions of the form:
+//
+//	BigInt -= long
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator-=(long value)
+{
+	uncache();
+	unshare();
+	uint32_t word;
+	if (!small_long(value, &word))
+		return *this -= BasicBigInt(value);
+	return (value < 0) ? add_word(word) : sub_word(word);
+}
+
+// Subtract a single word from this value, without building a BigInt for
+// it.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::sub_word(uint32_t word)
+{
+	uncache();
+	unshare();
+	if (negative)
+		return add_word_magnitude(word);
+
+	// a - w: if the word is bigger than a, the result is -(w - a)
+	//
+	uint32_t magnitude;
+	if (word_value(&magnitude) && magnitude < word)
+	{
+		if (!set_value((unsigned long)(word - magnitude)))
+			return false;
+		negative = true;
+		return true;
+	}
+	subtract_word_magnitude(word);
+	return true;
+}
+
+// Subtract a word from the magnitude.  We're assuming that our magnitude
+// is at least as big as the word.
+//
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::subtract_word_magnitude(uint32_t word)
+{
+	unshare();
+	uint64_t borrow = word;
+	for (long i=lsd; borrow; i--)
+	{
+		uint64_t digit = borrow & DIGITMASK;
+		borrow >>= DIGITBITS;
+		if (value[i] < digit)
+		{
+			value[i] = (DIGIT)(((uint64_t)value[i] + ((uint64_t)1 << DIGITBITS) - digit) & DIGITMASK);
+			++borrow;
+		}
+		else
+			value[i] -= (DIGIT)digit;
+	}
+	for (; msd<lsd && value[msd]==0; msd++);
+	if (zero())
+		negative = false;
+}
+
+// Subtract from the given BigInt.  We're assuming that its value is at
+// least as big as ours.
 //
-bool BigInt::subtract_from_BigInt(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::subtract_from_BigInt(const BasicBigInt& bi)
 {
+	unshare();
 	// Allocate a place to hold the result as we build it, and
 	// initialize an index at the end.  Use the size of bi, 
 	// since we won't need any more.
@@ -732,8 +1340,10 @@ bool BigInt::subtract_from_BigInt(const BigInt& bi)
 // Subtract out the given BigInt.  We're assuming that our value is at
 // least as big as the BigInt.
 //
-void BigInt::subtract_BigInt(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::subtract_BigInt(const BasicBigInt& bi)
 {
+	unshare();
 	// Subtract digit-by-digit, until we run out of digits.
 	//
 	SIGNEDDIGIT borrow = 0;
@@ -753,18 +1363,17 @@ void BigInt::subtract_BigInt(const BigInt& bi)
 		while (value[i] == 0)
 			value[i--] = DIGITMASK;
 		--value[i];
-		if (value[i] == 0)
-			++msd;
 	}
-	else
-		for (; msd<lsd && value[msd]==0; msd++);
+	for (; msd<lsd && value[msd]==0; msd++);
 }
 
 // Subtract out the given digit.  We're assuming that our value is at
 // least as big as the digit.
 //
-void BigInt::subtract_digit(DIGIT digit)
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::subtract_digit(DIGIT digit)
 {
+	unshare();
 	SIGNEDTWODIGITS diff = value[lsd] - digit;
 	value[lsd] = (DIGIT)(diff & (TWODIGITS)DIGITMASK);
 
@@ -787,32 +1396,89 @@ void BigInt::subtract_digit(DIGIT digit)
 //
 //	BigInt * (anything from which a BigInt can be constructed)
 //
-BigInt BigInt::operator*(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator*(const BasicBigInt& bi) const
 {
-	BigInt result = *this;
+	BasicBigInt result = *this;
 	result *= bi;
 	return result;
 }
 
 // This operator handles expressions of the form:
 //
-//	long * BigInt
+//	BigInt * long
 //
-// NOTE: This function is not a method of this class, we're just friends
-//
-BigInt operator*(long value, const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator*(long value) const
 {
-	BigInt result = value;
-	result *= bi;
+	BasicBigInt result = *this;
+	result *= value;
 	return result;
 }
 
+// This operator handles expressions of the form:
+//
+//	BigInt *= long
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator*=(long value)
+{
+	uncache();
+	unshare();
+	uint32_t word;
+	if (!small_long(value, &word))
+		return *this *= BasicBigInt(value);
+	if (!mul_word(word))
+		return false;
+	if (value < 0 && !zero())
+		negative = !negative;
+	return true;
+}
+
+// Multiply the magnitude by a single word in one pass, without building
+// a BigInt for it.  The sign is left alone, unless the result is zero.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::mul_word(uint32_t word)
+{
+	uncache();
+	unshare();
+	if (!word)
+		return set_zero();
+
+	// The product has at most WORDDIGITS more digits
+	//
+	if (msd < WORDDIGITS && !extend(WORDDIGITS - msd))
+		return false;
+
+	uint64_t carry = 0;
+	long i;
+	for (i=lsd; i>=msd; i--)
+	{
+		carry += (uint64_t)value[i] * word;
+		value[i] = (DIGIT)(carry & DIGITMASK);
+		carry >>= DIGITBITS;
+	}
+	for ( ; carry; i--)
+	{
+		value[i] = (DIGIT)(carry & DIGITMASK);
+		carry >>= DIGITBITS;
+	}
+	msd = i+1;
+	for (; msd<lsd && value[msd]==0; msd++);
+
+	return true;
+}
+
 // This operator handles expressions of the form:
 //
 //	BigInt *= (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator*=(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator*=(const BasicBigInt& bi)
 {
+	uncache();
+	unshare();
 	// Handle special cases first
 	//
 	if (msd == lsd)
@@ -822,7 +1488,7 @@ bool BigInt::operator*=(const BigInt& bi)
 		else if (value[lsd] == 1)
 		{
 			if (negative) // negative_one()
-				return copy_value(bi.value, bi.lsd+1, !bi.negative);
+				return copy_value(bi.value, bi.lsd+1, !bi.negative && !bi.zero());
 			else // one()
 				return copy_value(bi.value, bi.lsd+1, bi.negative);
 		}
@@ -843,6 +1509,11 @@ bool BigInt::operator*=(const BigInt& bi)
 		}
 	}
 
+	// Hand large operands to the kernels
+	//
+	if (lsd-msd+1 >= KERNELDIGITS && bi.lsd-bi.msd+1 >= KERNELDIGITS)
+		return kernel_multiply(bi);
+
 	// Allocate space to hold the result value as we build it
 	//
 	long result_lsd = lsd-msd + bi.lsd-bi.msd + 1;
@@ -874,8 +1545,16 @@ bool BigInt::operator*=(const BigInt& bi)
 	return use_value(result, result_lsd+1, (this->negative != bi.negative));
 }
 
-bool BigInt::square()
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::square()
 {
+	uncache();
+	unshare();
+	// Hand large operands to the kernels
+	//
+	if (lsd-msd+1 >= KERNELDIGITS)
+		return kernel_square();
+
 	// Allocate space to hold the result as we build it
 	//
 	long result_lsd = 2*(lsd-msd) + 1;
@@ -899,14 +1578,20 @@ bool BigInt::square()
 
 		// Multiply the rest by the current digit, times two, and
 		// add in the result
+		// Doubling the product can overflow two digits, and so can the
+		// sum; each carry out is worth one more in the digit above.
 		for (j=i-1, --k; j>=msd; j--, k--)
 		{
 			TWODIGITS tmp2 = (TWODIGITS)value[j] * (TWODIGITS)value[i];
-			TWODIGITS hibit = tmp2 & (TWODIGITS)((TWODIGITS)DIGITHIGHBIT<<DIGITBITS);
-			tmp += (tmp2*2) + (TWODIGITS)result[k];
+			TWODIGITS carry = tmp2 >> (2*DIGITBITS-1);
+			tmp2 <<= 1;
+			tmp += tmp2;
+			carry += (tmp < tmp2);
+			tmp += (TWODIGITS)result[k];
+			carry += (tmp < (TWODIGITS)result[k]);
 			result[k] = (DIGIT)(tmp & DIGITMASK);
 			tmp >>= DIGITBITS;
-			tmp |= hibit >> (DIGITBITS-1);
+			tmp += carry << DIGITBITS;
 		}
 
 		// Add in any remaining carry
@@ -923,11 +1608,87 @@ bool BigInt::square()
 	return use_value(result, result_lsd+1, false);
 }
 
-bool BigInt::squaremod(const BigInt& modulator)
+// Multiply by the given BigInt using the arithmetic kernels.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::kernel_multiply(const BasicBigInt& bi)
+{
+	long an = limb_count();
+	long bn = bi.limb_count();
+
+	// One allocation holds both packed operands and the product.  bi may
+	// be this BigInt, so both are packed before anything is changed.
+	//
+	LIMB* work = new LIMB[2*(an+bn)];
+	if (!work)  return false;
+	LIMB* a = work;
+	LIMB* b = &work[an];
+	LIMB* r = &work[an+bn];
+	to_limbs(a, an);
+	bi.to_limbs(b, bn);
+
+	bigint_mul(r, a, an, b, bn);
+
+	bool result = from_limbs(r, an+bn, (this->negative != bi.negative));
+	delete[] work;
+	return result;
+}
+
+// Square this BigInt using the arithmetic kernels.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::kernel_square()
+{
+	long n = limb_count();
+	LIMB* work = new LIMB[3*n];
+	if (!work)  return false;
+	to_limbs(work, n);
+	bigint_sqr(&work[n], work, n);
+
+	bool result = from_limbs(&work[n], 2*n, false);
+	delete[] work;
+	return result;
+}
+
+// Divide the magnitude by bi's using the arithmetic kernels, setting the
+// magnitude of the quotient into quot and of the remainder into rem;
+// either may be NULL, or this BigInt.  The magnitude must be no less
+// than bi's.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::kernel_divide(const BasicBigInt& bi, BasicBigInt* quot, BasicBigInt* rem) const
+{
+	long an = limb_count();
+	long dn = bi.limb_count();
+	long qn = an-dn+1;
+
+	// Both operands are packed before either result is set, since bi or
+	// this may be one of them
+	//
+	LIMB* work = new LIMB[an+dn+qn+dn];
+	if (!work)  return false;
+	LIMB* a = work;
+	LIMB* d = &work[an];
+	LIMB* q = &work[an+dn];
+	LIMB* r = &work[an+dn+qn];
+	to_limbs(a, an);
+	bi.to_limbs(d, dn);
+	bigint_divrem(q, r, a, an, d, dn);
+
+	bool result = (!quot || quot->from_limbs(q, qn, false)) &&
+		(!rem || rem->from_limbs(r, dn, false));
+	delete[] work;
+	return result;
+}
+
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::squaremod(const BasicBigInt& modulator)
 {
+	uncache();
+	unshare();
 	long mid = (lsd-msd+1)/2;
 
-	BigInt a, b;
+	BasicBigInt a, b;
 	a.copy_value(&value[msd], mid);
 	a *= a;
 
@@ -937,17 +1698,19 @@ bool BigInt::squaremod(const BigInt& modulator)
 		a %= modulator;
 		b.copy_value(&value[msd], i);
 		b <<= DIGITBITS;
-		b *= (TWODIGITS_CONSTYPE)(value[i+msd] * 2);
-		a += b + (TWODIGITS_CONSTYPE)(value[i+msd]*value[i+msd]);
+		b *= (unsigned long)(value[i+msd] * 2);
+		a += b + (unsigned long)(value[i+msd]*value[i+msd]);
 
 		a %= modulator;
 	}
 	return copy_value(a.value, a.lsd+1);
 }
 
-bool BigInt::negate()
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::negate()
 {
-	this->negative = !this->negative;
+	uncache();
+	this->negative = !this->negative;	// the digits can stay shared
 	return true;
 }
 
@@ -957,32 +1720,210 @@ bool BigInt::negate()
 //
 //	BigInt / (anything from which a BigInt can be constructed)
 //
-BigInt BigInt::operator/(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator/(const BasicBigInt& bi) const
 {
-	BigInt result = *this;
+	BasicBigInt result = *this;
 	result /= bi;
 	return result;
 }
 
 // This operator handles expressions of the form:
 //
-//	long / BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
+//	BigInt / long
 //
-BigInt operator/(long value, const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator/(long value) const
 {
-	BigInt result = value;
-	result /= bi;
+	BasicBigInt result = *this;
+	result /= value;
 	return result;
 }
 
+// This operator handles expressions of the form:
+//
+//	BigInt /= long
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator/=(long value)
+{
+	uncache();
+	unshare();
+	uint32_t word;
+	if (!small_long(value, &word))
+		return *this /= BasicBigInt(value);
+	if (!word)
+		return false;
+	divmod_word(word);
+	if (value < 0 && !zero())
+		negative = !negative;
+	return true;
+}
+
+// Divide by the given BigInt, which must divide this value exactly;
+// if it doesn't, the result is meaningless.  Rather than working down
+// from the top like general division, this works up from the bottom
+// (Jebelean's exact division): each quotient limb is whatever clears the
+// lowest remaining limb, found by multiplying by the divisor's inverse
+// mod 2^64, and only the limbs the quotient will occupy ever need
+// updating.  Returns false if dividing by zero.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::divexact(const BasicBigInt& bi)
+{
+	uncache();
+	unshare();
+	if (bi.zero())
+		return false;
+	if (zero())
+		return true;
+	bool result_negative = (this->negative != bi.negative);
+
+	uint32_t word;
+	if (bi.word_value(&word))
+	{
+		divmod_word(word);
+		this->negative = result_negative && !zero();
+		return true;
+	}
+
+	// Strip the divisor's trailing zero bits, and as many from this
+	// value, to leave an odd divisor that has an inverse
+	//
+	long zeros = 0;
+	long i;
+	for (i=bi.lsd; !bi.value[i]; i--)
+		zeros += DIGITBITS;
+	for (DIGIT d=bi.value[i]; !(d & 1); d>>=1)
+		++zeros;
+	BasicBigInt divisor = bi;
+	divisor >>= zeros;
+	*this >>= zeros;
+
+	long dn = divisor.limb_count();
+	long an = limb_count();
+	if (an < dn)
+		return set_zero();
+	long qn = an - dn + 1;
+
+	LIMB* work = new LIMB[qn+dn];
+	if (!work)  return false;
+	LIMB* r = work;
+	LIMB* d = &work[qn];
+	to_limbs(r, qn);	// only the low qn limbs matter
+	divisor.to_limbs(d, dn);
+
+	// Adding q[i] * d at limb i, with q[i] = r[i] * -1/d mod 2^64, clears
+	// limb i.  The q[i] limbs are kept in r[i] as they're found, and make
+	// up -quotient mod 2^(64*qn).
+	//
+	LIMB minv = bigint_montgomery_inverse(d[0]);
+	for (i=0; i<qn; i++)
+	{
+		LIMB q = r[i] * minv;
+		long n = (dn < qn-i) ? dn : qn-i;
+		LIMB carry = bigint_kernels()->addmul_1(&r[i], d, n, q);
+		for (long k=i+n; carry && k<qn; k++)
+		{
+			r[k] += carry;
+			carry = (r[k] < carry);
+		}
+		r[i] = q;
+	}
+
+	// Negate to get the quotient
+	//
+	LIMB borrow = 0;
+	for (i=0; i<qn; i++)
+	{
+		LIMB limb = r[i];
+		r[i] = 0 - limb - borrow;
+		borrow = (limb | borrow) != 0;
+	}
+
+	bool ok = from_limbs(r, qn, result_negative);
+	delete[] work;
+	if (ok && zero())
+		negative = false;
+	return ok;
+}
+
+// One step of dividing by a word: divides the two-word n by d, returning
+// the quotient and leaving the remainder in *r.  d must have its high bit
+// set, and v must be floor((2^64-1)/d) - 2^32, so the quotient comes from
+// a multiply and a couple of corrections instead of a divide instruction.
+// See Moller and Granlund, "Improved division by invariant integers".
+//
+static inline uint32_t divide_word_step(uint64_t n, uint32_t d, uint32_t v, uint32_t* r)
+{
+	uint32_t n1 = (uint32_t)(n >> 32);
+	uint32_t n0 = (uint32_t)n;
+	uint64_t q = (uint64_t)v * n1 + n;
+	uint32_t q1 = (uint32_t)(q >> 32) + 1;
+	uint32_t rem = n0 - q1*d;
+	if (rem > (uint32_t)q)
+	{
+		--q1;
+		rem += d;
+	}
+	if (rem >= d)
+	{
+		++q1;
+		rem -= d;
+	}
+	*r = rem;
+	return q1;
+}
+
+// Divide the magnitude by a non-zero word in one pass, truncating, and
+// return the remainder.  The sign is left alone, unless the quotient is
+// zero.
+//
+template <typename Digit, typename TwoDigits>
+uint32_t BasicBigInt<Digit, TwoDigits>::divmod_word(uint32_t word)
+{
+	uncache();
+	unshare();
+	// Normalize the divisor so its high bit is set, and find its inverse
+	//
+	int shift = 0;
+	uint32_t d = word;
+	while (!(d & 0x80000000))
+	{
+		d <<= 1;
+		++shift;
+	}
+	uint32_t v = (uint32_t)(~(uint64_t)0 / d - ((uint64_t)1 << 32));
+
+	// Each step divides the remainder so far, with the next digit
+	// appended, by the word.  Both are shifted to match the normalized
+	// divisor, which doesn't change the quotient, and the quotient fits
+	// in a digit since the remainder is less than the word.
+	//
+	uint32_t r = 0;
+	for (long i=msd; i<=lsd; i++)
+	{
+		uint64_t n = (((uint64_t)r << DIGITBITS) | value[i]) << shift;
+		uint32_t rem;
+		value[i] = (DIGIT)divide_word_step(n, d, v, &rem);
+		r = rem >> shift;
+	}
+	for (; msd<lsd && value[msd]==0; msd++);
+	if (zero())
+		negative = false;
+
+	return r;
+}
+
 // This operator handles expressions of the form:
 //
 //	BigInt /= (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator/=(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator/=(const BasicBigInt& bi)
 {
+	uncache();
+	unshare();
 	// If dividing by zero, return false
 	// TODO: do more?
 	//
@@ -1014,28 +1955,14 @@ bool BigInt::operator/=(const BigInt& bi)
 	if (value_compare(bi) == -1)
 		return set_zero();
 
-	BigInt quot;
-	BigInt mod;
-	long i;
-	DIGIT j;
-	for (i=msd; i<=lsd; i++)
-		for (j=DIGITHIGHBIT; j; j>>=1)
-		{
-			quot.shift_left_one();
-			mod.shift_left_one();
-			if (value[i] & j)
-				mod.value[mod.lsd] |= 1;
-			if (mod.value_compare(bi) != -1)
-			{
-				mod.subtract_BigInt(bi);
-				++quot;
-			}
-		}
-
-	// Whatever we're left with in quot is the quotient.  The sign is 
-	// determined from this sign and the sign of bi.
+	// The sign of the quotient is determined from this sign and the sign
+	// of bi, which is read first in case bi is this BigInt.
 	//
-	return copy_value(quot.value, quot.lsd+1, (this->negative != bi.negative));
+	bool result_negative = (this->negative != bi.negative);
+	if (!kernel_divide(bi, this, NULL))
+		return false;
+	this->negative = result_negative;
+	return true;
 }
 
 
@@ -1046,26 +1973,55 @@ bool BigInt::operator/=(const BigInt& bi)
 //
 //	BigInt % (anything from which a BigInt can be constructed)
 //
-BigInt BigInt::operator%(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator%(const BasicBigInt& bi) const
 {
-	BigInt result = *this;
+	BasicBigInt result = *this;
 	result %= bi;
 	return result;
 }
 
 // This operator handles expressions of the form:
 //
-//	long % BigInt
+//	BigInt % long
 //
-// NOTE: This function is not a method of this class, we're just friends
-//
-BigInt operator%(long value, const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator%(long value) const
 {
-	BigInt result = value;
-	result %= bi;
+	BasicBigInt result = *this;
+	result %= value;
 	return result;
 }
 
+// This operator handles expressions of the form:
+//
+//	BigInt %= long
+//
+// This is the same "modulo" as below: the result takes the sign of the 
+// modulator.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator%=(long value)
+{
+	uncache();
+	uint32_t word;
+	if (!small_long(value, &word))
+		return *this %= BasicBigInt(value);
+	if (!word)
+		return false;
+
+	// Only the remainder is wanted, so there's no need to unshare (copy)
+	// the digits just to divide them in place
+	//
+	uint32_t r = mod_word(word);
+	if (r && negative != (value < 0))
+		r = word - r;
+	if (!set_value((unsigned long)r))
+		return false;
+	negative = (r && value < 0);
+	return true;
+}
+
 // This operator handles expressions of the form:
 //
 //	BigInt %= (anything from which a BigInt can be constructed)
@@ -1079,8 +2035,11 @@ BigInt operator%(long value, const BigInt& bi)
 // We're implementing the "modulo" version here, because that's what the 
 // thing we're replacing used.
 //
-bool BigInt::operator%=(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator%=(const BasicBigInt& bi)
 {
+	uncache();
+	unshare();
 	// If dividing by zero, return false
 	// TODO: do more?
 	//
@@ -1098,28 +2057,18 @@ bool BigInt::operator%=(const BigInt& bi)
 	case -1:
 		break;
 	case 1:
-		BigInt mod(bi.lsd-bi.msd+2, (DIGIT)0);
-		long i;
-		DIGIT j;
-		for (i=msd; i<=lsd; i++)
-		{
-			for (j=DIGITHIGHBIT; j; j>>=1)
-			{
-				mod.shift_left_one();
-				if (value[i] & j)
-					mod.value[mod.lsd] |= 1;
-				if (mod.value_compare(bi) != -1)
-					mod.subtract_BigInt(bi);
-			}
-		}
-		if (!copy_value(mod.value, mod.lsd+1, this->negative))
+		bool was_negative = this->negative;
+		if (!kernel_divide(bi, NULL, this))
 			return false;
+		this->negative = was_negative;
 		break;
 	}
 	
 	// If the signs are different, the value of the modulation is the 
-	// modulator minus the value we just calculated.
+	// modulator minus the value we just calculated.  Zero stays zero.
 	//
+	if (zero())
+		return set_zero();
 	if (this->negative != bi.negative)
 	{
 		if (!subtract_from_BigInt(bi))
@@ -1134,10 +2083,13 @@ bool BigInt::operator%=(const BigInt& bi)
 }
 
 
-bool BigInt::multmod(const BigInt& mult, const BigInt& mod)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::multmod(const BasicBigInt& mult, const BasicBigInt& mod)
 {
-	BigInt x = *this % mod;
-	BigInt y = mult % mod;
+	uncache();
+	unshare();
+	BasicBigInt x = *this % mod;
+	BasicBigInt y = mult % mod;
 	set_zero();
 	long i;
 	DIGIT j;
@@ -1161,12 +2113,13 @@ bool BigInt::multmod(const BigInt& mult, const BigInt& mod)
 // This function returns this BigInt raised to the power of the given 
 // BigInt.
 //
-BigInt BigInt::exp(const BigInt& bi)
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::exp(const BasicBigInt& bi)
 {
 	// TODO: handle negative exponents?
 	if (bi.negative)
 	{
-		BigInt result;	// zero
+		BasicBigInt result;	// zero
 		return result;
 	}
 	
@@ -1174,7 +2127,7 @@ BigInt BigInt::exp(const BigInt& bi)
 	//
 	if (bi.zero())
 	{
-		BigInt result = (unsigned long)1;
+		BasicBigInt result = (unsigned long)1;
 		return result;
 	}
 	
@@ -1182,15 +2135,15 @@ BigInt BigInt::exp(const BigInt& bi)
 	//
 	if (bi.one())
 	{
-		BigInt result = *this;
+		BasicBigInt result = *this;
 		return result;
 	}
 
 	// Make a copy which we can manipulate, and initialize the 
 	// result value to one.
 	//
-	BigInt me = *this;
-	BigInt result = (unsigned long)1;
+	BasicBigInt me = *this;
+	BasicBigInt result = (unsigned long)1;
 
 	// Do all of the bits in all of the digits except the msd.
 	//
@@ -1236,20 +2189,27 @@ BigInt BigInt::exp(const BigInt& bi)
 // This function returns this BigInt raised to the power of exponent, then 
 // modulated by modulator.
 //
-BigInt BigInt::expmod(const BigInt& exponent, const BigInt& modulator) const
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::expmod(const BasicBigInt& exponent, const BasicBigInt& modulator) const
 {
 	// TODO: handle negative exponents?
 	if (exponent.negative)
 	{
-		BigInt result;	// zero
+		BasicBigInt result;	// zero
 		return result;
 	}
+
+	// Odd moduli can use Montgomery multiplication, which is much faster
+	//
+	if (modulator.odd() && modulator.is_positive() && !modulator.one() &&
+		!exponent.zero())
+		return montgomery_expmod(exponent, modulator);
 	
 	// Make a copy which we can manipulate, and initialize the 
 	// result value to one.
 	//
-	BigInt me = *this;
-	BigInt result = (unsigned long)1;
+	BasicBigInt me = *this;
+	BasicBigInt result = (unsigned long)1;
 
 	// Do all of the bits in all of the digits except the msd.
 	//
@@ -1306,41 +2266,399 @@ BigInt BigInt::expmod(const BigInt& exponent, const BigInt& modulator) const
 }
 
 
-BigInt& BigInt::get_partial(BigInt** partials, long pindex, const BigInt& modulator) const
+// Returns the number of significant bits in e[0..en-1], but at least one.
+//
+static long limb_bits(const LIMB* e, long en)
 {
-	if (!partials[pindex])
+	long ebits = en*LIMBBITS;
+	while (ebits > 1 && !((e[(ebits-1)/LIMBBITS] >> ((ebits-1)%LIMBBITS)) & 1))
+		--ebits;
+	return ebits;
+}
+
+// Returns the window size to use for an exponent of ebits bits.  Bigger
+// windows mean fewer multiplies, but more time spent filling in the table
+// first.
+//
+static int expmod_window(long ebits)
+{
+	int window = (ebits > 512) ? 6 : (ebits > 128) ? 5 : (ebits > 32) ? 4 :
+		(ebits > 8) ? 3 : 1;
+	if (window > WINDOWSIZE)
+		window = WINDOWSIZE;
+	return window;
+}
+
+// Returns the window of bits bit..bit+window-1 of the exponent e[0..en-1].
+//
+static long exponent_window(const LIMB* e, long en, long bit, int window)
+{
+	if (bit/LIMBBITS >= en)
+		return 0;
+	long bits = (long)(e[bit/LIMBBITS] >> (bit%LIMBBITS));
+	if (bit%LIMBBITS + window > LIMBBITS && bit/LIMBBITS+1 < en)
+		bits |= (long)(e[bit/LIMBBITS+1] << (LIMBBITS - bit%LIMBBITS));
+	return bits & ((1L << window) - 1);
+}
+
+// This function returns this BigInt raised to the power of exponent, 
+// modulated by modulator, for a positive odd modulator greater than one.
+// The values are packed into limbs once and stay in Montgomery form 
+// (x * 2^(64n) mod modulator) for the whole exponentiation, so the
+// kernels' Montgomery multiplication can do all of the work without any
+// division inside the loop.  The exponent is taken a window of bits at a
+// time from the top, using a table of the first 2^window powers.
+//
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::montgomery_expmod(const BasicBigInt& exponent, const BasicBigInt& modulator) const
+{
+	long n = modulator.limb_count();
+	long en = exponent.limb_count();
+
+	LIMB* m = new LIMB[n];
+	LIMB* e = new LIMB[en];
+	if (!m || !e)
 	{
-		partials[pindex] = new BigInt(*this);
-		*partials[pindex] %= modulator;
+		delete[] m;
+		delete[] e;
+		return BasicBigInt();
+	}
+	modulator.to_limbs(m, n);
+	exponent.to_limbs(e, en);
+	LIMB minv = bigint_montgomery_inverse(m[0]);
+	void (*montmul)(LIMB*, const LIMB*, const LIMB*, const LIMB*, long, LIMB) =
+		(n <= FIXEDMONTLIMBS) ? fixed_montmul[n] : bigint_kernels()->montmul;
 
-		if (pindex > 1)
+	long ebits = limb_bits(e, en);
+	int window = expmod_window(ebits);
+	long entries = 1L << window;
+
+	BasicBigInt mont_one = BasicBigInt((unsigned long)1).montgomery_form(modulator, n*LIMBBITS);
+	BasicBigInt mont_base = montgomery_form(modulator, n*LIMBBITS);
+
+	LIMB* table = new LIMB[(entries+2)*n];
+	if (!table)
+	{
+		delete[] m;
+		delete[] e;
+		return BasicBigInt();
+	}
+	LIMB* acc = &table[entries*n];
+	LIMB* unit = &table[(entries+1)*n];
+	mont_one.to_limbs(&table[0], n);
+	mont_base.to_limbs(&table[n], n);
+	for (long i=2; i<entries; i++)
+		montmul(&table[i*n], &table[(i-1)*n], &table[n], m, n, minv);
+	memcpy(acc, &table[0], n*LIMBBYTES);
+
+	bool started = false;
+	for (long bit=(ebits-1)/window*window; bit>=0; bit-=window)
+	{
+		// Squaring one is a waste of time, so skip it until the first 
+		// nonzero window
+		if (started)
+			for (int i=0; i<window; i++)
+				montmul(acc, acc, acc, m, n, minv);
+
+		long bits = exponent_window(e, en, bit, window);
+
+		if (bits)
 		{
-			// look for a pair of partials which make up this partial
+			montmul(acc, acc, &table[bits*n], m, n, minv);
+			started = true;
+		}
+	}
 
-			int k;
-			for (k=1; k<=pindex>>1; k += 2)
+	// Multiplying by plain one takes the value back out of Montgomery form
+	//
+	memset(unit, 0, n*LIMBBYTES);
+	unit[0] = 1;
+	montmul(acc, acc, unit, m, n, minv);
+
+	BasicBigInt result;
+	result.from_limbs(acc, n, false);
+	delete[] table;
+	delete[] m;
+	delete[] e;
+	return result;
+}
+
+// Returns the Montgomery form of this value, x * 2^bits mod modulator.
+// The value has to be reduced first, and must end up strictly less than
+// the modulator.
+//
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::montgomery_form(const BasicBigInt& modulator, long bits) const
+{
+	BasicBigInt result = *this % modulator;
+	if (result.value_compare(modulator) >= 0)
+		result.set_zero();
+	result <<= bits;
+	result %= modulator;
+	return result;
+}
+
+// This function computes results[i] = bases[i].expmod(exponents[i],
+// modulators[i]) for i in 0..count-1.  When the kernels can do several
+// Montgomery multiplications side by side in vector lanes, the
+// exponentiations with odd moduli are done that many at a time, sorted
+// by size so each group pads its moduli as little as possible; the rest
+// are done one by one.  Returns false if it runs out of memory.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::expmod_many(const BasicBigInt* bases, const BasicBigInt* exponents,
+						 const BasicBigInt* modulators, BasicBigInt* results, long count)
+{
+	long* order = new long[count > 0 ? count : 1];
+	if (!order)
+		return false;
+
+	// Group sizes and the lane layout must come from the same kernels
+	const BigIntKernels* kernels = bigint_kernels();
+	long eligible = 0;
+	for (long i=0; i<count; i++)
+	{
+		const BasicBigInt& m = modulators[i];
+		if (kernels->lanes && m.odd() && m.is_positive() && !m.one() &&
+			m.lsd-m.msd+1 <= LANEMAXBITS/DIGITBITS &&
+			!exponents[i].negative && !exponents[i].zero())
+		{
+			// Insertion sort by modulus size
+			long j = eligible++;
+			while (j > 0 && modulators[order[j-1]].limb_count() > m.limb_count())
 			{
-				if (partials[k] && partials[pindex-1-k])
-				{
-					*partials[pindex] *= *partials[k];
-					*partials[pindex] %= modulator;
-					*partials[pindex] *= *partials[pindex-1-k];
-					*partials[pindex] %= modulator;
-					break;
-				}
+				order[j] = order[j-1];
+				--j;
 			}
-
-			if (k > pindex>>1) // never found a precalculated pair
-				*partials[pindex] = partials[pindex]->expmod(pindex, modulator);
+			order[j] = i;
 		}
+		else
+			results[i] = bases[i].expmod(exponents[i], m);
 	}
 
-	return *partials[pindex];
+	bool ok = true;
+	for (long g=0; ok && g<eligible; g+=kernels->lanes)
+	{
+		long in_group = eligible-g;
+		if (in_group > kernels->lanes)
+			in_group = kernels->lanes;
+		ok = expmod_lanes(bases, exponents, modulators, results, &order[g], in_group, kernels);
+	}
+
+	delete[] order;
+	return ok;
 }
 
+// Spread the limbs x[0..xn-1] into lane 'lane' of the interleaved lane
+// digits r, n digits of 'bits' bits each.
+//
+static void limbs_to_lane(uint64_t* r, long n, int lanes, int lane, int bits,
+						  const LIMB* x, long xn)
+{
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	for (long j=0; j<n; j++)
+	{
+		long bit = j*bits;
+		uint64_t d = 0;
+		if (bit/LIMBBITS < xn)
+			d = x[bit/LIMBBITS] >> (bit%LIMBBITS);
+		if (bit%LIMBBITS + bits > LIMBBITS && bit/LIMBBITS+1 < xn)
+			d |= x[bit/LIMBBITS+1] << (LIMBBITS - bit%LIMBBITS);
+		r[j*lanes+lane] = d & mask;
+	}
+}
 
-/* Find the inverse of "x mod n". Normal inverses are the number by which you
-   multiply the original number such that the answer is 1. Modular inverses are
+// Collect lane 'lane' of the interleaved lane digits a back into limbs
+// r[0..rn-1].
+//
+static void lane_to_limbs(LIMB* r, long rn, const uint64_t* a, long n,
+						  int lanes, int lane, int bits)
+{
+	memset(r, 0, rn*LIMBBYTES);
+	for (long j=0; j<n; j++)
+	{
+		long bit = j*bits;
+		uint64_t d = a[j*lanes+lane];
+		if (bit/LIMBBITS < rn)
+			r[bit/LIMBBITS] |= d << (bit%LIMBBITS);
+		if (bit%LIMBBITS + bits > LIMBBITS && bit/LIMBBITS+1 < rn)
+			r[bit/LIMBBITS+1] |= d >> (LIMBBITS - bit%LIMBBITS);
+	}
+}
+
+// Does the exponentiations for up to one item per vector lane, as picked
+// out by which[0..count-1], the same way as montgomery_expmod() but with
+// every step applied to all of the lanes at once, by the given kernels.  Unused lanes get a
+// modulus of one, so they stay zero throughout.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::expmod_lanes(const BasicBigInt* bases, const BasicBigInt* exponents,
+						  const BasicBigInt* modulators, BasicBigInt* results,
+						  const long* which, long count, const BigIntKernels* kernels)
+{
+	int lanes = kernels->lanes;
+	int bits = kernels->lanebits;
+
+	long mn = 1, en = 1;
+	for (long k=0; k<count; k++)
+	{
+		if (modulators[which[k]].limb_count() > mn)
+			mn = modulators[which[k]].limb_count();
+		if (exponents[which[k]].limb_count() > en)
+			en = exponents[which[k]].limb_count();
+	}
+	long n = (mn*LIMBBITS + bits-1) / bits;
+
+	LIMB* limbs = new LIMB[(mn+1) + lanes*en];
+	uint64_t* minv = new uint64_t[lanes];
+	uint64_t* m = new uint64_t[n*lanes];
+	uint64_t* acc = new uint64_t[n*lanes];
+	uint64_t* pick = new uint64_t[n*lanes];
+	if (!limbs || !minv || !m || !acc || !pick)
+	{
+		delete[] limbs;
+		delete[] minv;
+		delete[] m;
+		delete[] acc;
+		delete[] pick;
+		return false;
+	}
+	LIMB* e = &limbs[mn+1];
+
+	long ebits = 1;
+	for (int l=0; l<lanes; l++)
+	{
+		if (l < count)
+		{
+			exponents[which[l]].to_limbs(&e[l*en], en);
+			long b = limb_bits(&e[l*en], en);
+			if (b > ebits)
+				ebits = b;
+			modulators[which[l]].to_limbs(limbs, mn);
+		}
+		else
+		{
+			memset(&e[l*en], 0, en*LIMBBYTES);
+			memset(limbs, 0, mn*LIMBBYTES);
+			limbs[0] = 1;
+		}
+		limbs_to_lane(m, n, lanes, l, bits, limbs, mn);
+		minv[l] = bigint_montgomery_inverse(limbs[0]) & (((uint64_t)1 << bits) - 1);
+	}
+
+	int window = expmod_window(ebits);
+	long entries = 1L << window;
+	uint64_t* table = new uint64_t[entries*n*lanes];
+	if (!table)
+	{
+		delete[] limbs;
+		delete[] minv;
+		delete[] m;
+		delete[] acc;
+		delete[] pick;
+		return false;
+	}
+
+	// Montgomery forms of one and of each base
+	//
+	for (long k=0; k<count; k++)
+	{
+		const BasicBigInt& modulator = modulators[which[k]];
+		BasicBigInt((unsigned long)1).montgomery_form(modulator, n*bits).to_limbs(limbs, mn+1);
+		limbs_to_lane(&table[0], n, lanes, k, bits, limbs, mn+1);
+		bases[which[k]].montgomery_form(modulator, n*bits).to_limbs(limbs, mn+1);
+		limbs_to_lane(&table[n*lanes], n, lanes, k, bits, limbs, mn+1);
+	}
+	for (long k=count; k<lanes; k++)
+		for (long j=0; j<n; j++)
+			table[j*lanes+k] = table[(n+j)*lanes+k] = 0;
+	for (long i=2; i<entries; i++)
+		kernels->montmul_lanes(&table[i*n*lanes], &table[(i-1)*n*lanes],
+							   &table[n*lanes], m, n, minv);
+	memcpy(acc, &table[0], n*lanes*sizeof(uint64_t));
+
+	bool started = false;
+	for (long bit=(ebits-1)/window*window; bit>=0; bit-=window)
+	{
+		if (started)
+			for (int i=0; i<window; i++)
+				kernels->montmul_lanes(acc, acc, acc, m, n, minv);
+
+		// Each lane has its own exponent, and so its own table entry
+		bool any = false;
+		for (int l=0; l<lanes; l++)
+		{
+			long entry = exponent_window(&e[l*en], en, bit, window);
+			any = any || entry;
+			for (long j=0; j<n; j++)
+				pick[j*lanes+l] = table[(entry*n+j)*lanes+l];
+		}
+		if (any)
+		{
+			kernels->montmul_lanes(acc, acc, pick, m, n, minv);
+			started = true;
+		}
+	}
+
+	// Multiplying by plain one takes the values back out of Montgomery form
+	//
+	memset(pick, 0, n*lanes*sizeof(uint64_t));
+	for (int l=0; l<lanes; l++)
+		pick[l] = 1;
+	kernels->montmul_lanes(acc, acc, pick, m, n, minv);
+
+	bool ok = true;
+	for (long k=0; k<count; k++)
+	{
+		lane_to_limbs(limbs, mn, acc, n, lanes, k, bits);
+		ok = results[which[k]].from_limbs(limbs, mn, false) && ok;
+	}
+
+	delete[] table;
+	delete[] limbs;
+	delete[] minv;
+	delete[] m;
+	delete[] acc;
+	delete[] pick;
+	return ok;
+}
+
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits>& BasicBigInt<Digit, TwoDigits>::get_partial(BasicBigInt** partials, long pindex, const BasicBigInt& modulator) const
+{
+	if (!partials[pindex])
+	{
+		partials[pindex] = new BasicBigInt(*this);
+		*partials[pindex] %= modulator;
+
+		if (pindex > 1)
+		{
+			// look for a pair of partials which make up this partial
+
+			int k;
+			for (k=1; k<=pindex>>1; k += 2)
+			{
+				if (partials[k] && partials[pindex-1-k])
+				{
+					*partials[pindex] *= *partials[k];
+					*partials[pindex] %= modulator;
+					*partials[pindex] *= *partials[pindex-1-k];
+					*partials[pindex] %= modulator;
+					break;
+				}
+			}
+
+			if (k > pindex>>1) // never found a precalculated pair
+				*partials[pindex] = partials[pindex]->expmod(pindex, modulator);
+		}
+	}
+
+	return *partials[pindex];
+}
+
+
+/* Find the inverse of "x mod n". Normal inverses are the number by which you
+   multiply the original number such that the answer is 1. Modular inverses are
    similar: the modular inverse of "x mod n" is an integer (y) such that
    "(x*y) mod n = 1".
 
@@ -1365,15 +2683,16 @@ BigInt& BigInt::get_partial(BigInt** partials, long pindex, const BigInt& modula
 			  
    -- Jorj Bauer <jorj@dejavusoftware.com> 5/26/00
 */
-BigInt BigInt::inv(const BigInt& modulator) const
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::inv(const BasicBigInt& modulator) const
 {
 	unsigned long step;
 	
 	step = 0;
 	
-	BigInt bi_a, bi_b, bi_ret, bi_remainder, bi_prevremainder, bi_res;
-	BigInt bi_p[3];
-	BigInt bi_q[3];
+	BasicBigInt bi_a, bi_b, bi_ret, bi_remainder, bi_prevremainder, bi_res;
+	BasicBigInt bi_p[3];
+	BasicBigInt bi_q[3];
 	bi_a = modulator;
 	bi_b = *this;
 	
@@ -1421,69 +2740,2407 @@ BigInt BigInt::inv(const BigInt& modulator) const
 		//    printf("Error?\n");
 		bi_ret = (const char *)"0";
 	}
-	
-	return (bi_ret); // return (floor(ret));
-}
-
+	
+	return (bi_ret); // return (floor(ret));
+}
+
+
+
+// GCD
+
+// This function returns the greatest common divisor of this BigInt and
+// the given BigInt.
+//
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::gcd(const BasicBigInt& bi) const
+{
+	// If the given value is zero, return the absolute value of this
+	//
+	if (bi.zero())
+	{
+		BasicBigInt result = *this;
+		result.negative = false;
+		return result;
+	}
+
+	// Make a copy of each which we can manipulate.
+	//
+	BasicBigInt val1 = *this;
+	BasicBigInt val2 = bi;
+
+	// Find GCD by repeated modulation
+	//
+	while (!val2.zero())
+	{
+		val1 %= val2;
+		if (val1.zero())
+			break;
+		val2 %= val1;
+	}
+
+	if (val1.zero())
+		return val2;
+	else
+		return val1;
+}
+
+
+
+// Roots
+
+// Returns the square root of the value, rounded down, or zero if the value
+// is negative.
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::isqrt() const
+{
+	BasicBigInt root;
+	isqrt_rem(&root, NULL);
+	return root;
+}
+
+// Set *root to the square root of the value, rounded down, and *rem to
+// what's left over, value - root^2.  Either may be NULL, or this BigInt.
+// Returns false, setting neither, if the value is negative.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::isqrt_rem(BasicBigInt* root, BasicBigInt* rem) const
+{
+	if (negative)
+		return false;
+
+	BasicBigInt s, r;
+	sqrtrem(&s, &r);
+	if (root)
+		*root = s;
+	if (rem)
+		*rem = r;
+	return true;
+}
+
+// Returns the k-th root of the value, rounded toward zero.  Negative values
+// only have odd roots; their even roots, and the 0th root of anything, are
+// returned as zero.
+//
+// This is Newton's method on f(x) = x^k - value, in integers: starting
+// from a power of two no smaller than the root, each step
+//
+//	x = ((k-1)x + value / x^(k-1)) / k
+//
+// gets closer from above, until it stops going down.
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::iroot(unsigned long k) const
+{
+	if (k == 0 || (negative && !(k & 1)))
+		return BasicBigInt(0L);
+	if (k == 1 || zero())
+		return *this;
+	if (k == 2)
+		return isqrt();
+
+	BasicBigInt n = *this;
+	n.negative = false;
+	unsigned long bits = num_bits();
+	if (k >= bits)
+	{
+		// Only 1 has fewer bits than k when raised to the k-th power
+		BasicBigInt one = 1L;
+		one.negative = negative;
+		return one;
+	}
+
+	BasicBigInt x = 1L;
+	x <<= (bits + k-1) / k;
+	for (;;)
+	{
+		BasicBigInt y = n / x.exp(BasicBigInt((long)(k-1)));
+		BasicBigInt scaled = x;
+		scaled *= (long)(k-1);
+		y += scaled;
+		y /= (long)k;
+		if (y >= x)
+			break;
+		x = y;
+	}
+
+	x.negative = negative;
+	return x;
+}
+
+// Returns true if the value is the square of an integer.  Most values
+// that aren't are caught by their remainders mod 64, 63, 65 and 11, which
+// have to be squares mod those: bit i of each mask is set if i is a square
+// mod the modulus.  Only about 1 in 150 values gets past them to have its
+// square root taken.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::is_square() const
+{
+	static const uint64_t squares64 = 0x0202021202030213ULL;
+	static const uint64_t squares63 = 0x0402483012450293ULL;
+	static const uint64_t squares65[2] = { 0x218a019866014613ULL, 0x1ULL };
+	static const uint64_t squares11 = 0x23b;
+
+	if (negative)
+		return false;
+
+	if (!((squares64 >> (value[lsd] & 63)) & 1))
+		return false;
+
+	// The other three at once, from the remainder mod 63*65*11
+	uint32_t rem = mod_word(63*65*11);
+	if (!((squares63 >> (rem % 63)) & 1) ||
+		!((squares65[rem % 65 / 64] >> (rem % 65 % 64)) & 1) ||
+		!((squares11 >> (rem % 11)) & 1))
+		return false;
+
+	BasicBigInt root, rest;
+	sqrtrem(&root, &rest);
+	return rest.zero();
+}
+
+// Returns true if the value is some integer to the power of two or more,
+// setting *base and *exponent (either may be NULL) to the one with the
+// biggest exponent.  Negative values count only with odd exponents, and 0,
+// 1 and -1 aren't counted, since they're any power of themselves.
+//
+// A value that's b^k is (b^(k/p))^p for each prime p dividing k, so only
+// prime exponents are tried, in order up to the number of bits.  After a
+// hit, the root is tried again from the same prime, since smaller ones
+// would have been found first.  Before taking a p-th root, the value has
+// to be a p-th power mod a few small primes q = 1 mod p, where only one
+// in p of the non-zero remainders is; and when it's even, p has to divide
+// the number of trailing zero bits.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::is_perfect_power(BasicBigInt* base, unsigned long* exponent) const
+{
+	BasicBigInt n = *this;
+	unsigned long total = 1;
+	unsigned long p = negative ? 3 : 2;
+
+	for (;;)
+	{
+		unsigned long bits = n.num_bits();
+		unsigned long zeros = n.ctz();
+		if (bits < 2)
+			break;
+
+		BasicBigInt root;
+		for (; p < bits; p += (p == 2 ? 1 : 2))
+		{
+			if (!small_prime(p) || (zeros && zeros % p))
+				continue;
+
+			if (p == 2)
+			{
+				if (!n.is_square())
+					continue;
+				root = n.isqrt();
+				break;
+			}
+
+			if (!n.power_residue(p))
+				continue;
+			root = n.iroot(p);
+			if (BasicBigInt(root).exp(BasicBigInt((long)p)) == n)
+				break;
+		}
+		if (p >= bits)
+			break;
+
+		n = root;
+		total *= p;
+	}
+
+	if (total == 1)
+		return false;
+	if (base)
+		*base = n;
+	if (exponent)
+		*exponent = total;
+	return true;
+}
+
+// Returns true if the value is a p-th power mod each of the first few
+// primes q = 1 mod p (it's one if its remainder r is zero or
+// r^((q-1)/p) = 1 mod q), or if there are no such q below 2^32.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::power_residue(unsigned long p) const
+{
+	int tried = 0;
+	for (uint64_t q = 2*(uint64_t)p+1; tried < 4 && q < 0xFFFFFFFFULL; q += 2*p)
+	{
+		if (!small_prime(q))
+			continue;
+		++tried;
+
+		uint64_t r = mod_word((uint32_t)q);
+		if (!r)
+			continue;
+		uint64_t result = 1;
+		for (uint64_t e = (q-1) / p; e; e >>= 1)
+		{
+			if (e & 1)
+				result = result * r % q;
+			r = r * r % q;
+		}
+		if (result != 1)
+			return false;
+	}
+	return true;
+}
+
+// Square roots of values with more bits than this are split up by
+// Zimmermann's Karatsuba square root; smaller ones are found by Newton's
+// method.
+#define SQRTNEWTONBITS 256
+
+// Set *s and *r to the square root and remainder of the magnitude, by
+// Zimmermann's "Karatsuba square root" (see Brent and Zimmermann, "Modern
+// Computer Arithmetic", algorithm 1.12).  The value is split into four
+// pieces of h bits (the top one longer),
+//
+//	a3 2^3h + a2 2^2h + a1 2^h + a0
+//
+// and the square root of the top half, s' with remainder r', gives the
+// next h bits of the root as q = (r' 2^h + a1) / 2s'.  So it takes one
+// half-size square root and one quarter-size division, and the cost is
+// that of the division.
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::sqrtrem(BasicBigInt* s, BasicBigInt* r) const
+{
+	unsigned long bits = num_bits();
+	if (bits <= SQRTNEWTONBITS)
+	{
+		sqrtrem_newton(s, r);
+		return;
+	}
+
+	unsigned long h = (bits-1) / 4;
+	BasicBigInt mask = 1L;
+	mask <<= h;
+	mask -= 1L;
+
+	BasicBigInt top = *this;
+	top.negative = false;
+	top >>= 2*h;
+	BasicBigInt a1 = *this;
+	a1.negative = false;
+	a1 >>= h;
+	a1 &= mask;
+	BasicBigInt a0 = *this;
+	a0.negative = false;
+	a0 &= mask;
+
+	BasicBigInt s1, r1;
+	top.sqrtrem(&s1, &r1);
+
+	// q, u = (r' 2^h + a1) divmod 2s'
+	r1 <<= h;
+	r1 += a1;
+	s1 <<= 1;
+	BasicBigInt q, u;
+	if (r1.value_compare(s1) >= 0)
+		r1.kernel_divide(s1, &q, &u);
+	else
+		u = r1;
+	s1 >>= 1;
+
+	// s = s' 2^h + q, r = u 2^h + a0 - q^2, which may be one too far
+	s1 <<= h;
+	s1 += q;
+	u <<= h;
+	u += a0;
+	q.square();
+	u -= q;
+	while (u.negative)
+	{
+		u += s1;
+		u += s1;
+		u -= 1L;
+		s1 -= 1L;
+	}
+
+	*s = s1;
+	*r = u;
+}
+
+// The same by Newton's method, x = (x + value / x) / 2, starting from a
+// power of two no smaller than the root.  Values of one limb are done in
+// a single word.
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::sqrtrem_newton(BasicBigInt* s, BasicBigInt* r) const
+{
+	BasicBigInt n = *this;
+	n.negative = false;
+	unsigned long bits = num_bits();
+
+	if (limb_count() == 1)
+	{
+		LIMB v;
+		to_limbs(&v, 1);
+		LIMB x = (LIMB)1 << ((bits+1) / 2);
+		while (v)
+		{
+			LIMB y = (x + v/x) >> 1;
+			if (y >= x)
+				break;
+			x = y;
+		}
+		if (!v)
+			x = 0;
+		LIMB rest = v - x*x;
+		s->from_limbs(&x, 1, false);
+		r->from_limbs(&rest, 1, false);
+		return;
+	}
+
+	BasicBigInt x = 1L;
+	x <<= (bits+1) / 2;
+	for (;;)
+	{
+		BasicBigInt y = n / x;
+		y += x;
+		y >>= 1;
+		if (y >= x)
+			break;
+		x = y;
+	}
+
+	BasicBigInt square = x;
+	square.square();
+	n -= square;
+	*s = x;
+	*r = n;
+}
+
+
+
+// Primality
+
+// Returns true if the value is probably prime, by the Baillie-PSW test: a
+// strong Fermat test to base 2 and a strong Lucas test, which no one has
+// found a composite to pass.  Any rounds more are strong Fermat tests to
+// the odd primes from 3 up.  Values below a million are decided by trial
+// division, and bigger ones are divided by the primes below 1000 first,
+// which throws out most composites more cheaply.  Negative values aren't
+// prime.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::is_probable_prime(int rounds) const
+{
+	if (negative || zero() || one())
+		return false;
+	if (even())
+		return *this == 2L;
+
+	// A remainder mod a product of several primes at once, taken a word
+	// at a time, tells us about each of them
+	uint32_t product = 1;
+	long first = 0;
+	for (long i=0; i<=SMALLPRIMES; i++)
+	{
+		if (i < SMALLPRIMES && product <= 0xFFFFFFFFUL / small_primes[i])
+		{
+			product *= small_primes[i];
+			continue;
+		}
+
+		uint32_t rem = mod_word(product);
+		for (long j=first; j<i; j++)
+			if (rem % small_primes[j] == 0)
+				return *this == (long)small_primes[j];
+		if (i < SMALLPRIMES)
+		{
+			product = small_primes[i];
+			first = i;
+		}
+	}
+	if (*this < 1000000L)
+		return true;
+
+	if (!strong_probable_prime(BasicBigInt(2L)) || !strong_lucas_probable_prime())
+		return false;
+	for (int i=0; i<rounds && i<SMALLPRIMES; i++)
+		if (!strong_probable_prime(BasicBigInt((long)small_primes[i])))
+			return false;
+	return true;
+}
+
+// The strong Fermat (Miller-Rabin) test to the given base: with n-1 =
+// d 2^s and d odd, a prime n has base^d = 1, or base^(d 2^r) = -1 for
+// some r < s.  The exponentiation is done in Montgomery form by expmod().
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::strong_probable_prime(const BasicBigInt& base) const
+{
+	BasicBigInt less = *this;
+	less -= 1L;
+	unsigned long s = less.ctz();
+	BasicBigInt d = less;
+	d >>= s;
+
+	BasicBigInt x = base.expmod(d, *this);
+	if (x.one() || x == less)
+		return true;
+	for (unsigned long r=1; r<s; r++)
+	{
+		x.square();
+		x %= *this;
+		if (x == less)
+			return true;
+		if (x.one())
+			return false;
+	}
+	return false;
+}
+
+// The strong Lucas test with Selfridge's parameters: D is the first of 5,
+// -7, 9, -11, ... with (D/n) = -1, P = 1 and Q = (1-D)/4.  With n+1 =
+// d 2^s and d odd, a prime n has U(d) = 0, or V(d 2^r) = 0 for some r <
+// s, mod n.  Squares have no such D, so they're ruled out first.
+//
+// U and V are doubled by U(2k) = U(k) V(k) and V(2k) = V(k)^2 - 2Q^k, and
+// stepped by U(k+1) = (U(k) + V(k))/2 and V(k+1) = (D U(k) + V(k))/2,
+// going down the bits of d.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::strong_lucas_probable_prime() const
+{
+	if (is_square())
+		return false;
+
+	long D = 5;
+	for (;;)
+	{
+		int j = jacobi(D);
+		if (j == -1)
+			break;
+		if (j == 0)
+			return false;	// D and n share a factor, and n is the bigger
+		D = (D > 0) ? -(D+2) : -(D-2);
+	}
+	long Q = (1-D) / 4;
+
+	BasicBigInt d = *this;
+	d += 1L;
+	unsigned long s = d.ctz();
+	d >>= s;
+
+	BasicBigInt bigD = D;
+	bigD %= *this;
+	BasicBigInt bigQ = Q;
+	bigQ %= *this;
+
+	BasicBigInt U = 1L, V = 1L, Qk = bigQ;
+	for (long bit=(long)d.num_bits()-2; bit>=0; bit--)
+	{
+		U *= V;
+		U %= *this;
+		V.square();
+		V -= Qk;
+		V -= Qk;
+		V %= *this;
+		Qk.square();
+		Qk %= *this;
+
+		if (d.testbit(bit))
+		{
+			BasicBigInt next = U;
+			next += V;
+			U *= bigD;
+			U += V;
+			V = U;
+			U = next;
+
+			if (U.odd())
+				U += *this;
+			U >>= 1;
+			U %= *this;
+			if (V.odd())
+				V += *this;
+			V >>= 1;
+			V %= *this;
+
+			Qk *= bigQ;
+			Qk %= *this;
+		}
+	}
+
+	if (U.zero() || V.zero())
+		return true;
+	for (unsigned long r=1; r<s; r++)
+	{
+		V.square();
+		V -= Qk;
+		V -= Qk;
+		V %= *this;
+		if (V.zero())
+			return true;
+		Qk.square();
+		Qk %= *this;
+	}
+	return false;
+}
+
+// Primes below this are sieved out of the candidates next_prime() looks
+// at, in windows of this many odd numbers.
+#define SIEVELIMIT 16384
+#define SIEVEWINDOW 4096
+
+// Returns the smallest prime bigger than the value (2 for anything below
+// 2), as far as is_probable_prime() can tell.
+//
+// The remainders of the first candidate mod each odd prime below
+// SIEVELIMIT are taken once, two primes to a pass over the digits.  From
+// those, a window of the odd numbers that follow has its multiples of
+// each prime crossed off, and only what's left is tested; the next window
+// just adds to the remainders.  About one candidate in eight survives.
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::next_prime() const
+{
+	if (*this < 2L)
+		return BasicBigInt(2L);
+
+	BasicBigInt n = *this;
+	n += n.odd() ? 2L : 1L;
+	if (n == 3L)
+		return n;
+
+	// The sieve would cross off small primes themselves
+	if (n < (long)SIEVELIMIT)
+	{
+		while (!n.is_probable_prime(0))
+			n += 2L;
+		return n;
+	}
+
+	// The odd primes below SIEVELIMIT, by sieving
+	bool* composite = new bool[SIEVELIMIT];
+	uint32_t* primes = new uint32_t[SIEVELIMIT/2];
+	uint32_t* residue = new uint32_t[SIEVELIMIT/2];
+	bool* crossed = new bool[SIEVEWINDOW];
+	if (!composite || !primes || !residue || !crossed)
+	{
+		delete[] composite;
+		delete[] primes;
+		delete[] residue;
+		delete[] crossed;
+		return BasicBigInt();
+	}
+	memset(composite, 0, SIEVELIMIT*sizeof(bool));
+	long count = 0;
+	for (uint32_t p=3; p<SIEVELIMIT; p+=2)
+	{
+		if (composite[p])
+			continue;
+		primes[count++] = p;
+		for (uint32_t q=p*p; q<SIEVELIMIT; q+=2*p)
+			composite[q] = true;
+	}
+
+	for (long j=0; j<count; j+=2)
+	{
+		if (j+1 < count)
+		{
+			uint32_t rem = n.mod_word(primes[j] * primes[j+1]);
+			residue[j] = rem % primes[j];
+			residue[j+1] = rem % primes[j+1];
+		}
+		else
+			residue[j] = n.mod_word(primes[j]);
+	}
+
+	for (;;)
+	{
+		// n + 2i is a multiple of p when i = -n/2 mod p
+		memset(crossed, 0, SIEVEWINDOW*sizeof(bool));
+		for (long j=0; j<count; j++)
+		{
+			uint32_t p = primes[j];
+			uint32_t i = (uint32_t)((uint64_t)(p - residue[j]) % p * ((p+1)/2) % p);
+			for (; i<SIEVEWINDOW; i+=p)
+				crossed[i] = true;
+		}
+
+		long last = 0;
+		for (long i=0; i<SIEVEWINDOW; i++)
+		{
+			if (crossed[i])
+				continue;
+			n += 2*(i-last);
+			last = i;
+			if (n.is_probable_prime(0))
+			{
+				delete[] composite;
+				delete[] primes;
+				delete[] residue;
+				delete[] crossed;
+				return n;
+			}
+		}
+
+		n += 2*(SIEVEWINDOW-last);
+		for (long j=0; j<count; j++)
+			residue[j] = (residue[j] + 2*SIEVEWINDOW) % primes[j];
+	}
+}
+
+// Set the value to a random prime of the given number of bits, from the
+// system's random source.  Returns false, leaving zero, if it can't be
+// read or bits is less than 2.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::random_prime(unsigned long bits)
+{
+	FILE* source = fopen("/dev/urandom", "rb");
+	if (!source)
+	{
+		set_zero();
+		return false;
+	}
+	bool result = random_prime(bits, read_random, source);
+	fclose(source);
+	return result;
+}
+
+// The same, with random bytes from random(context, buffer, length), which
+// returns false if it can't fill the buffer.  The top two bits are always
+// set, so the product of two such primes has exactly twice as many bits.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::random_prime(unsigned long bits, bool (*random)(void*, unsigned char*, long), void* context)
+{
+	set_zero();
+	if (bits < 2)
+		return false;
+
+	long length = (long)((bits+7) / 8);
+	unsigned char* bytes = new unsigned char[length];
+	if (!bytes)
+		return false;
+
+	for (;;)
+	{
+		if (!random(context, bytes, length))
+		{
+			delete[] bytes;
+			return false;
+		}
+
+		// Big-endian, so the spare bits are at the front
+		int spare = (int)(length*8 - bits);
+		bytes[0] &= 0xFF >> spare;
+		bytes[0] |= 0x80 >> spare;
+		if (spare < 7)
+			bytes[0] |= 0x40 >> spare;
+		else
+			bytes[1] |= 0x80;
+
+		BasicBigInt start(bytes, length);
+		start -= 1L;
+		BasicBigInt prime = start.next_prime();
+		if (prime.num_bits() == bits)
+		{
+			*this = prime;
+			delete[] bytes;
+			return true;
+		}
+	}
+}
+
+// Returns the Jacobi symbol (D/n) for this odd, positive n and a small D.
+// (-1/n) is 1 if n = 1 mod 4, and -1 otherwise; for odd |D|, (|D|/n) is
+// (n/|D|) by quadratic reciprocity, unless both are 3 mod 4.
+template <typename Digit, typename TwoDigits>
+int BasicBigInt<Digit, TwoDigits>::jacobi(long D) const
+{
+	unsigned long a = (D < 0) ? -(unsigned long)D : (unsigned long)D;
+	int n4 = value[lsd] & 3;
+	int result = jacobi_word(mod_word((uint32_t)a), a);
+	if ((a & 3) == 3 && n4 == 3)
+		result = -result;
+	if (D < 0 && n4 == 3)
+		result = -result;
+	return result;
+}
+
+
+
+// Factoring
+
+// Pollard's rho takes this many steps between gcds.
+#define RHOBATCH 128
+
+// factor() gives rho about this many steps before going to ECM.
+#define RHOSTEPS 65536
+
+// The ECM bounds factor() tries in turn, with the number of curves that
+// should find most factors of the given number of digits.
+//
+static const struct
+{
+	unsigned long B1;
+	long curves;
+	long digits;
+} ecm_levels[] = {
+	{ 2000, 25, 15 },
+	{ 11000, 90, 20 },
+	{ 50000, 200, 25 },
+	{ 250000, 430, 30 },
+	{ 1000000, 900, 35 },
+	{ 3000000, 2350, 40 },
+};
+#define ECMLEVELS ((long)(sizeof(ecm_levels) / sizeof(ecm_levels[0])))
+
+// factor() uses the quadratic sieve on numbers in this range.  Below it
+// rho is quicker, and above it the dense elimination gets too big.
+#define SIQSMINBITS 100
+#define SIQSMAXBITS 333
+
+// Returns the prime factors of the magnitude in factors, smallest first
+// and each as many times as it divides, and how many there are (none for
+// 0 and 1).  factors needs room for num_bits() of them.
+//
+// Factors below 1000 are found by trial division.  What's left is split
+// until each piece is prime, as far as is_probable_prime() can tell:
+// first by Brent's variant of Pollard's rho, which takes time on the
+// order of the square root of the factor it finds, and when that's slow
+// by ECM with growing bounds, whose time depends less on the factor's
+// size.  Pieces in the quadratic sieve's range only get ECM up to a
+// quarter of their digits before the sieve, whose time depends on the
+// size of the piece alone, takes over.  Anything still left over goes
+// back to rho for as long as it takes.
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::factor(BasicBigInt* factors) const
+{
+	BasicBigInt n = *this;
+	n.negative = false;
+	long count = 0;
+	if (n < 2L)
+		return 0;
+
+	unsigned long twos = n.ctz();
+	n >>= twos;
+	while (count < (long)twos)
+		factors[count++] = 2L;
+
+	for (long i=0; i<SMALLPRIMES && !n.one(); i++)
+	{
+		uint32_t p = small_primes[i];
+		if (n < (long)(p*p))
+			break;
+		while (n.mod_word(p) == 0)
+		{
+			n.divmod_word(p);
+			factors[count++] = (long)p;
+		}
+	}
+	factor_rest(n, factors, &count);
+
+	// The pieces are found in no particular order
+	for (long i=1; i<count; i++)
+		for (long j=i; j>0 && factors[j] < factors[j-1]; j--)
+		{
+			BasicBigInt swap = factors[j];
+			factors[j] = factors[j-1];
+			factors[j-1] = swap;
+		}
+	return count;
+}
+
+// Add the prime factors of n, which is odd and has none below 1000, to
+// factors[*count] on.
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::factor_rest(const BasicBigInt& n, BasicBigInt* factors, long* count)
+{
+	if (n.one())
+		return;
+	if (n.is_probable_prime(0))
+	{
+		factors[(*count)++] = n;
+		return;
+	}
+
+	// Rho can't always pull a prime power apart, so take its root, and
+	// repeat the root's factors
+	BasicBigInt base;
+	unsigned long exponent;
+	if (n.is_perfect_power(&base, &exponent))
+	{
+		long first = *count;
+		factor_rest(base, factors, count);
+		long found = *count - first;
+		for (unsigned long e=1; e<exponent; e++)
+			for (long i=0; i<found; i++)
+				factors[(*count)++] = factors[first+i];
+		return;
+	}
+
+	long bits = n.num_bits();
+	bool sieve = (bits >= SIQSMINBITS && bits <= SIQSMAXBITS);
+	BasicBigInt d = pollard_brent(n, 1, RHOSTEPS);
+	for (long i=0; i<ECMLEVELS && d == n; i++)
+	{
+		if (sieve && 4*ecm_levels[i].digits > bits*3/10)
+			break;
+		n.ecm(&d, ecm_levels[i].B1, 100*ecm_levels[i].B1, ecm_levels[i].curves);
+	}
+	if (d == n && sieve)
+		n.siqs(&d);
+	for (LIMB c=2; d == n; c++)
+		d = pollard_brent(n, c, 0);
+
+	BasicBigInt rest = n;
+	rest.divexact(d);
+	factor_rest(d, factors, count);
+	factor_rest(rest, factors, count);
+}
+
+// r = a + b mod m, and r = a - b mod m, for n-limb a and b below m.  r may
+// be a or b.
+//
+static void add_mod_limbs(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m, long n)
+{
+	LIMB carry = 0;
+	long k;
+	for (k=0; k<n; k++)
+	{
+		LIMB sum = a[k] + carry;
+		carry = (sum < carry);
+		sum += b[k];
+		carry += (sum < b[k]);
+		r[k] = sum;
+	}
+
+	bool less = false;
+	for (k=n-1; k>=0; k--)
+		if (r[k] != m[k])
+		{
+			less = (r[k] < m[k]);
+			break;
+		}
+	if (carry || !less)
+	{
+		LIMB borrow = 0;
+		for (k=0; k<n; k++)
+		{
+			LIMB diff = r[k] - m[k] - borrow;
+			borrow = (r[k] < m[k]) || (r[k] == m[k] && borrow);
+			r[k] = diff;
+		}
+	}
+}
+
+static void sub_mod_limbs(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m, long n)
+{
+	LIMB borrow = 0;
+	long k;
+	for (k=0; k<n; k++)
+	{
+		LIMB diff = a[k] - b[k] - borrow;
+		borrow = (a[k] < b[k]) || (a[k] == b[k] && borrow);
+		r[k] = diff;
+	}
+	if (borrow)
+	{
+		LIMB carry = 0;
+		for (k=0; k<n; k++)
+		{
+			LIMB sum = r[k] + carry;
+			carry = (sum < carry);
+			sum += m[k];
+			carry += (sum < m[k]);
+			r[k] = sum;
+		}
+	}
+}
+
+// Look for a factor of the odd composite n with Brent's variant of
+// Pollard's rho: iterate y = y^2 + c mod n, which falls into a cycle mod
+// each prime p of n after about sqrt(p) steps, and compare y with a copy
+// x saved at each power of two, so gcd(x - y, n) turns up p when y comes
+// round.  The differences are multiplied together RHOBATCH at a time to
+// share one gcd, going back a step at a time if a batch overshoots to n.
+// Returns n if the cycles mod every prime closed at once, and the caller
+// should try another c, or if nothing turned up in about limit steps
+// (unless limit is 0).
+//
+// Everything is in Montgomery form (that only changes which c is used),
+// with FixedBigInt's multiplication for moduli of up to four limbs and the
+// kernels' beyond.
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::pollard_brent(const BasicBigInt& n, uint64_t c, unsigned long limit)
+{
+	long len = n.limb_count();
+	LIMB* work = new LIMB[7*len];
+	if (!work)
+		return n;
+	LIMB* m = work;
+	LIMB* x = &work[len];
+	LIMB* y = &work[2*len];
+	LIMB* ys = &work[3*len];
+	LIMB* q = &work[4*len];
+	LIMB* diff = &work[5*len];
+	LIMB* cc = &work[6*len];
+
+	n.to_limbs(m, len);
+	LIMB minv = bigint_montgomery_inverse(m[0]);
+	void (*montmul)(LIMB*, const LIMB*, const LIMB*, const LIMB*, long, LIMB) =
+		(len <= FIXEDMONTLIMBS) ? fixed_montmul[len] : bigint_kernels()->montmul;
+
+	memset(y, 0, len*LIMBBYTES);
+	y[0] = 2;
+	memset(cc, 0, len*LIMBBYTES);
+	cc[0] = c;
+	memset(q, 0, len*LIMBBYTES);
+	q[0] = 1;
+
+	BasicBigInt g = 1L;
+	BasicBigInt product;
+	for (unsigned long r=1; g.one() && (!limit || r <= limit); r*=2)
+	{
+		memcpy(x, y, len*LIMBBYTES);
+		for (unsigned long i=0; i<r; i++)
+		{
+			montmul(y, y, y, m, len, minv);
+			add_mod_limbs(y, y, cc, m, len);
+		}
+
+		for (unsigned long k=0; k<r && g.one(); k+=RHOBATCH)
+		{
+			memcpy(ys, y, len*LIMBBYTES);
+			for (unsigned long i=0; i<RHOBATCH && i<r-k; i++)
+			{
+				montmul(y, y, y, m, len, minv);
+				add_mod_limbs(y, y, cc, m, len);
+				sub_mod_limbs(diff, x, y, m, len);
+				montmul(q, q, diff, m, len, minv);
+			}
+			product.from_limbs(q, len, false);
+			g = product.gcd(n);
+		}
+	}
+
+	if (g.one())
+		g = n;
+	else if (g == n)
+	{
+		do
+		{
+			montmul(ys, ys, ys, m, len, minv);
+			add_mod_limbs(ys, ys, cc, m, len);
+			sub_mod_limbs(diff, x, ys, m, len);
+			product.from_limbs(diff, len, false);
+			g = product.gcd(n);
+		} while (g.one());
+	}
+
+	delete[] work;
+	return g;
+}
+
+
+// Lenstra's elliptic curve method.  Working mod n as if it were prime, a
+// point P on a curve has some multiple k P that is the identity mod a
+// prime p of n, and that shows up as a factor gcd(Z, n) once k is a
+// multiple of the order of the curve's group mod p.  The orders vary from
+// curve to curve around p, so among enough curves one is likely to be
+// smooth.  Stage 1 multiplies P by every prime power up to B1, and stage
+// 2 catches orders that are B1-smooth but for one prime up to B2.
+//
+// The curves are Montgomery's, B y^2 = x^3 + A x^2 + x, keeping only X:Z
+// of each point, in Montgomery form mod n.
+
+// Stage 2 takes giant steps of ECMSTEP P, with baby steps of j P for the
+// odd j below ECMSTEP/2 that are prime to it, of which there are
+// ECMBABIES; the primes q = k ECMSTEP +- j are then caught together, by
+// the X:Z of k ECMSTEP P matching that of j P mod p.
+#define ECMSTEP 2310
+#define ECMBABIES 240
+
+// The giant steps are sieved for primes this many at a time.
+#define ECMSEGMENT 64
+
+// What the threads working on one ecm() share.  The lock covers next,
+// found and factor.
+//
+struct EcmJob
+{
+	const LIMB* m;
+	long len;
+	LIMB minv;
+	void (*montmul)(LIMB*, const LIMB*, const LIMB*, const LIMB*, long, LIMB);
+
+	unsigned long B1;
+	unsigned long sigma;			// of curve 0
+	const unsigned char* composite;	// for the odd i up to B1, at i/2
+	const unsigned char* pairs;		// ECMBABIES bits for each giant step
+	unsigned long first_step;
+	unsigned long steps;
+
+	long curves;
+	long next;						// the next curve to run
+	long found;						// the first curve to find a factor, or curves
+	LIMB* factor;
+#if HAVE_PTHREAD
+	pthread_mutex_t lock;
+#endif
+};
+
+#if HAVE_PTHREAD
+#define FACTOR_LOCK(job) pthread_mutex_lock(&(job)->lock)
+#define FACTOR_UNLOCK(job) pthread_mutex_unlock(&(job)->lock)
+#else
+#define FACTOR_LOCK(job)
+#define FACTOR_UNLOCK(job)
+#endif
+
+// Returns the next curve to run, or -1 once they have all been run or a
+// factor has been found.
+//
+static long ecm_claim(EcmJob* job)
+{
+	FACTOR_LOCK(job);
+	long curve = job->next;
+	if (curve < job->curves && curve < job->found)
+		job->next++;
+	else
+		curve = -1;
+	FACTOR_UNLOCK(job);
+	return curve;
+}
+
+// Returns true if an earlier curve has found a factor, so there's no need
+// to go on with this one.
+//
+static bool ecm_stop(EcmJob* job, long curve)
+{
+	FACTOR_LOCK(job);
+	bool stop = job->found < curve;
+	FACTOR_UNLOCK(job);
+	return stop;
+}
+
+// Record the factor a curve found.  When several curves find one, the
+// earliest wins, so the result doesn't depend on how the threads ran.
+//
+static void ecm_report(EcmJob* job, long curve, const LIMB* factor)
+{
+	FACTOR_LOCK(job);
+	if (curve < job->found)
+	{
+		job->found = curve;
+		memcpy(job->factor, factor, job->len*LIMBBYTES);
+	}
+	FACTOR_UNLOCK(job);
+}
+
+static inline void ecm_mul(const EcmJob* job, LIMB* r, const LIMB* a, const LIMB* b)
+{
+	job->montmul(r, a, b, job->m, job->len, job->minv);
+}
+
+// r = 2 p, where a24 = (A + 2) / 4.  Points are X then Z.  r may be p,
+// and t needs room for two numbers.
+//
+static void ecm_double(const EcmJob* job, LIMB* r, const LIMB* p, const LIMB* a24, LIMB* t)
+{
+	long n = job->len;
+	LIMB* sum = t;
+	LIMB* diff = &t[n];
+
+	add_mod_limbs(sum, p, &p[n], job->m, n);
+	sub_mod_limbs(diff, p, &p[n], job->m, n);
+	ecm_mul(job, sum, sum, sum);
+	ecm_mul(job, diff, diff, diff);
+	ecm_mul(job, r, sum, diff);
+	sub_mod_limbs(sum, sum, diff, job->m, n);	// 4 X Z
+	ecm_mul(job, &r[n], a24, sum);
+	add_mod_limbs(&r[n], &r[n], diff, job->m, n);
+	ecm_mul(job, &r[n], &r[n], sum);
+}
+
+// r = p + q, given d = p - q.  r may be p or q but not d, and t needs
+// room for four numbers.
+//
+static void ecm_add(const EcmJob* job, LIMB* r, const LIMB* p, const LIMB* q, const LIMB* d, LIMB* t)
+{
+	long n = job->len;
+	LIMB* u = t;
+	LIMB* v = &t[n];
+	LIMB* a = &t[2*n];
+	LIMB* b = &t[3*n];
+
+	sub_mod_limbs(a, p, &p[n], job->m, n);
+	add_mod_limbs(b, q, &q[n], job->m, n);
+	ecm_mul(job, u, a, b);
+	add_mod_limbs(a, p, &p[n], job->m, n);
+	sub_mod_limbs(b, q, &q[n], job->m, n);
+	ecm_mul(job, v, a, b);
+	add_mod_limbs(a, u, v, job->m, n);
+	sub_mod_limbs(b, u, v, job->m, n);
+	ecm_mul(job, a, a, a);
+	ecm_mul(job, b, b, b);
+	ecm_mul(job, r, &d[n], a);
+	ecm_mul(job, &r[n], d, b);
+}
+
+// r = k p, for k of at least 1, by Montgomery's ladder.  r may be p, and
+// t needs room for eight numbers.
+//
+static void ecm_multiply(const EcmJob* job, LIMB* r, const LIMB* p, unsigned long k, const LIMB* a24, LIMB* t)
+{
+	long n = job->len;
+	LIMB* r0 = t;
+	LIMB* r1 = &t[2*n];
+	LIMB* scratch = &t[4*n];
+
+	memcpy(r0, p, 2*n*LIMBBYTES);
+	ecm_double(job, r1, p, a24, scratch);
+	for (int bit=bit_length(k)-2; bit>=0; bit--)
+		if ((k >> bit) & 1)
+		{
+			ecm_add(job, r0, r0, r1, p, scratch);
+			ecm_double(job, r1, r1, a24, scratch);
+		}
+		else
+		{
+			ecm_add(job, r1, r0, r1, p, scratch);
+			ecm_double(job, r0, r0, a24, scratch);
+		}
+	memcpy(r, r0, 2*n*LIMBBYTES);
+}
+
+// Multiply p by the biggest power of each prime up to B1.  Returns false
+// if an earlier curve found a factor meanwhile.
+//
+static bool ecm_stage1(EcmJob* job, long curve, LIMB* p, const LIMB* a24, LIMB* t)
+{
+	unsigned long B1 = job->B1;
+	unsigned long q;
+	for (q=2; q<=B1/2; q*=2)
+		;
+	ecm_multiply(job, p, p, q, a24, t);
+
+	for (unsigned long i=3; i<=B1; i+=2)
+	{
+		if ((i & 0xfff) == 1 && ecm_stop(job, curve))
+			return false;
+		if (job->composite[i/2])
+			continue;
+		for (q=i; q<=B1/i; q*=i)
+			;
+		ecm_multiply(job, p, p, q, a24, t);
+	}
+	return true;
+}
+
+// Multiply acc by X(k ECMSTEP p) Z(j p) - X(j p) Z(k ECMSTEP p) for every
+// prime k ECMSTEP +- j in the range, which is 0 mod p's order.  The cross
+// product comes from X Z of both points at one multiplication each:
+//
+//	Xk Zj - Xj Zk = (Xk - Xj)(Zk + Zj) - Xk Zk + Xj Zj
+//
+// t needs room for 3*ECMBABIES + 20 numbers.
+//
+static void ecm_stage2(const EcmJob* job, LIMB* acc, const LIMB* p, const LIMB* a24, LIMB* t)
+{
+	long n = job->len;
+	LIMB* baby = t;					// X, Z and X Z of each
+	LIMB* step = &t[3*ECMBABIES*n];
+	LIMB* a = &step[2*n];
+	LIMB* b = &a[2*n];
+	LIMB* c = &b[2*n];
+	LIMB* two = &c[2*n];
+	LIMB* xz = &two[2*n];
+	LIMB* cross = &xz[n];
+	LIMB* scratch = &cross[n];
+
+	// j p for odd j, each from the last two, keeping those prime to ECMSTEP
+	memcpy(a, p, 2*n*LIMBBYTES);
+	ecm_double(job, two, p, a24, scratch);
+	ecm_add(job, b, two, p, p, scratch);
+	long count = 0;
+	for (unsigned long j=1; j<ECMSTEP/2; j+=2)
+	{
+		if (j % 3 && j % 5 && j % 7 && j % 11)
+		{
+			LIMB* x = &baby[3*n*count++];
+			memcpy(x, a, 2*n*LIMBBYTES);
+			ecm_mul(job, &x[2*n], x, &x[n]);
+		}
+		ecm_add(job, c, b, two, a, scratch);
+		LIMB* rotate = a;
+		a = b;
+		b = c;
+		c = rotate;
+	}
+
+	// k ECMSTEP p for k from first_step on, each from the last two
+	unsigned long k = job->first_step;
+	ecm_multiply(job, step, p, ECMSTEP, a24, scratch);
+	if (k == 1)
+	{
+		memcpy(a, step, 2*n*LIMBBYTES);
+		ecm_double(job, b, step, a24, scratch);
+	}
+	else
+	{
+		ecm_multiply(job, a, p, k*ECMSTEP, a24, scratch);
+		ecm_multiply(job, b, p, (k+1)*ECMSTEP, a24, scratch);
+	}
+	for (unsigned long s=0; s<job->steps; s++)
+	{
+		const unsigned char* row = &job->pairs[s*(ECMBABIES/8)];
+		bool first = true;
+		for (long i=0; i<ECMBABIES; i++)
+		{
+			if (!(row[i/8] & (1 << (i%8))))
+				continue;
+			if (first)
+			{
+				ecm_mul(job, xz, a, &a[n]);
+				first = false;
+			}
+			LIMB* x = &baby[3*n*i];
+			sub_mod_limbs(cross, a, x, job->m, n);
+			add_mod_limbs(scratch, &a[n], &x[n], job->m, n);
+			ecm_mul(job, cross, cross, scratch);
+			sub_mod_limbs(cross, cross, xz, job->m, n);
+			add_mod_limbs(cross, cross, &x[2*n], job->m, n);
+			ecm_mul(job, acc, acc, cross);
+		}
+		ecm_add(job, c, b, step, a, scratch);
+		LIMB* rotate = a;
+		a = b;
+		b = c;
+		c = rotate;
+	}
+}
+
+// Mark which of the numbers k ECMSTEP +- j, for each giant step k and baby
+// step j, are primes in (B1, B2], sieving ECMSEGMENT giant steps at a time
+// by the odd primes in composite, which goes up to limit (at least the
+// root of B2).
+//
+static void ecm_sieve_pairs(unsigned char* pairs, unsigned long first_step, unsigned long steps,
+							unsigned long B1, unsigned long B2,
+							const unsigned char* composite, unsigned long limit)
+{
+	unsigned long babies[ECMBABIES];
+	long count = 0;
+	for (unsigned long j=1; j<ECMSTEP/2; j+=2)
+		if (j % 3 && j % 5 && j % 7 && j % 11)
+			babies[count++] = j;
+
+	unsigned char* segment = new unsigned char[(ECMSEGMENT+1)*ECMSTEP];
+	memset(pairs, 0, steps*(ECMBABIES/8));
+	for (unsigned long s=0; s<steps; s+=ECMSEGMENT)
+	{
+		unsigned long k = first_step + s;
+		unsigned long low = k*ECMSTEP - ECMSTEP/2;
+		unsigned long high = low + (ECMSEGMENT+1)*ECMSTEP - 1;
+		memset(segment, 0, (ECMSEGMENT+1)*ECMSTEP);
+		for (unsigned long p=3; p<=high/p && p<=limit; p+=2)
+		{
+			if (composite[p/2])
+				continue;
+			unsigned long multiple = (low + p - 1) / p * p;
+			if (multiple < p*p)
+				multiple = p*p;
+			for (; multiple<=high; multiple+=p)
+				segment[multiple-low] = 1;
+		}
+
+		for (unsigned long i=s; i<s+ECMSEGMENT && i<steps; i++)
+		{
+			unsigned long middle = (first_step + i)*ECMSTEP;
+			unsigned char* row = &pairs[i*(ECMBABIES/8)];
+			for (long b=0; b<ECMBABIES; b++)
+			{
+				unsigned long below = middle - babies[b];
+				unsigned long above = middle + babies[b];
+				if ((below > B1 && below <= B2 && !segment[below-low]) ||
+					(above > B1 && above <= B2 && !segment[above-low]))
+					row[b/8] |= 1 << (b%8);
+			}
+		}
+	}
+	delete[] segment;
+}
+
+// Look for a factor of the magnitude with Lenstra's elliptic curve
+// method, running stage 1 to B1 and stage 2 to B2 on up to the given
+// number of curves.  Returns true with a factor other than 1 and the
+// number itself (not necessarily prime) in *factor, or false if none of
+// the curves found one, or the number is prime.
+//
+// Curve i is Suyama's, from sigma = B1 + 7 + i, so that different bounds
+// try different curves.  The curves are shared out among as many threads
+// as there are processors; when several find a factor, the one from the
+// earliest curve is returned.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::ecm(BasicBigInt* factor, unsigned long B1, unsigned long B2, long curves) const
+{
+	BasicBigInt n = *this;
+	n.negative = false;
+	if (n < 4L || B1 < 2 || curves < 1)
+		return false;
+	if (n.even())
+	{
+		*factor = 2L;
+		return true;
+	}
+	if (n.is_probable_prime(0))
+		return false;
+
+	// Stage 2 sieves with the primes up to its root
+	unsigned long limit = B1;
+	if (B2 > B1)
+	{
+		unsigned long root = 1UL << ((bit_length(B2) + 1) / 2);
+		while (root > B2/root)
+			root = (root + B2/root) / 2;
+		if (root > limit)
+			limit = root;
+	}
+	unsigned char* composite = new unsigned char[limit/2 + 1];
+	memset(composite, 0, limit/2 + 1);
+	for (unsigned long i=3; i<=limit/i; i+=2)
+		if (!composite[i/2])
+			for (unsigned long multiple=i*i; multiple<=limit; multiple+=2*i)
+				composite[multiple/2] = 1;
+
+	EcmJob job;
+	long len = n.limb_count();
+	LIMB* limbs = new LIMB[2*len];
+	n.to_limbs(limbs, len);
+	job.m = limbs;
+	job.len = len;
+	job.minv = bigint_montgomery_inverse(limbs[0]);
+	job.montmul = (len <= FIXEDMONTLIMBS) ? fixed_montmul[len] : bigint_kernels()->montmul;
+	job.B1 = B1;
+	job.sigma = B1 + 7;
+	job.composite = composite;
+	job.pairs = NULL;
+	job.first_step = (B1/ECMSTEP > 1) ? B1/ECMSTEP : 1;
+	job.steps = 0;
+	job.curves = curves;
+	job.next = 0;
+	job.found = curves;
+	job.factor = &limbs[len];
+
+	unsigned char* pairs = NULL;
+	if (B2 > B1)
+	{
+		job.steps = (B2 + ECMSTEP/2) / ECMSTEP - job.first_step + 1;
+		pairs = new unsigned char[job.steps*(ECMBABIES/8)];
+		ecm_sieve_pairs(pairs, job.first_step, job.steps, B1, B2, composite, limit);
+		job.pairs = pairs;
+	}
+
+#if HAVE_PTHREAD
+	pthread_mutex_init(&job.lock, NULL);
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > curves)
+		threads = curves;
+	pthread_t* workers = (threads > 1) ? new pthread_t[threads-1] : NULL;
+	long started;
+	for (started=0; started<threads-1; started++)
+		if (pthread_create(&workers[started], NULL, ecm_worker, &job))
+			break;
+	ecm_worker(&job);
+	for (long i=0; i<started; i++)
+		pthread_join(workers[i], NULL);
+	delete[] workers;
+	pthread_mutex_destroy(&job.lock);
+#else
+	ecm_worker(&job);
+#endif
+
+	bool found = (job.found < curves);
+	if (found)
+		factor->from_limbs(job.factor, len, false);
+	delete[] pairs;
+	delete[] limbs;
+	delete[] composite;
+	return found;
+}
+
+// Run curves for ecm() until they're all done, on one of its threads.
+template <typename Digit, typename TwoDigits>
+void* BasicBigInt<Digit, TwoDigits>::ecm_worker(void* context)
+{
+	EcmJob* job = (EcmJob*)context;
+	long len = job->len;
+	LIMB* work = new LIMB[(3*ECMBABIES + 36)*len];
+	LIMB* p = work;
+	LIMB* a24 = &work[2*len];
+	LIMB* acc = &work[3*len];
+	LIMB* found = &work[4*len];
+	LIMB* t = &work[5*len];
+
+	BasicBigInt n;
+	n.from_limbs(job->m, len, false);
+	long bits = len*LIMBBITS;
+	long curve;
+	while ((curve = ecm_claim(job)) >= 0)
+	{
+		// Suyama's parametrization: with u = sigma^2 - 5 and v = 4 sigma,
+		// P = u^3 : v^3 and (A + 2) / 4 = (v - u)^3 (3 u + v) / (16 u^3 v)
+		BasicBigInt sigma = (long)(job->sigma + curve);
+		BasicBigInt u = (sigma*sigma - 5L) % n;
+		BasicBigInt v = (sigma*4L) % n;
+		BasicBigInt x = u*u % n * u % n;
+		BasicBigInt z = v*v % n * v % n;
+		BasicBigInt d = (v - u) % n;
+		BasicBigInt num = d*d % n * d % n * ((u*3L + v) % n) % n;
+		BasicBigInt den = x*v % n * 16L % n;
+		BasicBigInt g = den.gcd(n);
+		if (!g.one())
+		{
+			if (g != n)
+			{
+				g.to_limbs(found, len);
+				ecm_report(job, curve, found);
+			}
+			continue;
+		}
+		x.montgomery_form(n, bits).to_limbs(p, len);
+		z.montgomery_form(n, bits).to_limbs(&p[len], len);
+		(num * den.inv(n) % n).montgomery_form(n, bits).to_limbs(a24, len);
+
+		if (!ecm_stage1(job, curve, p, a24, t))
+			continue;
+		z.from_limbs(&p[len], len, false);
+		g = z.gcd(n);
+		if (g.one() && job->steps && !ecm_stop(job, curve))
+		{
+			BasicBigInt(1L).montgomery_form(n, bits).to_limbs(acc, len);
+			ecm_stage2(job, acc, p, a24, t);
+			z.from_limbs(acc, len, false);
+			g = z.gcd(n);
+		}
+		if (!g.one() && g != n)
+		{
+			g.to_limbs(found, len);
+			ecm_report(job, curve, found);
+		}
+	}
+
+	delete[] work;
+	return NULL;
+}
+
+// The self-initializing quadratic sieve.  It looks for x where
+//
+//	(A x + B)^2 - kN = A g(x),	g(x) = A x^2 + 2 B x + C
+//
+// splits over a factor base of the small primes p that kN is a square
+// mod, each giving a relation Y^2 = (product of primes) mod N.  Gaussian
+// elimination over GF(2) on the exponents finds sets of relations whose
+// products are squares on both sides, X^2 = Z^2 mod N, and gcd(X - Z, N)
+// is then a factor about half the time.
+//
+// The sieve adds log p where p divides g(x), for x in [-M, M), a cache
+// sized block at a time, and trial divides the x whose total comes close
+// to log g(x).  A is a product of s factor base primes near
+// sqrt(2kN)/M, which keeps g(x) small, and each A has 2^(s-1) values of
+// B that are stepped through in Gray code order, so the roots of g mod
+// each p move by an amount worked out once per A.  A relation with one
+// prime left over, below the large prime bound, is kept as a partial,
+// and two partials with the same prime make a relation between them.
+
+// The sieve array is done in blocks of this many bytes.
+#define SIQSBLOCK 32768
+
+// Primes below this aren't sieved with, which saves a lot of time for a
+// little accuracy; they're still tried in the trial division.
+#define SIQSSMALL 30
+
+// How many bits short of log g(x) the sieve may come and still have x
+// trial divided, for the primes it left out, prime powers, and values
+// well below the biggest.  Letting through more candidates than strictly
+// needed pays, as trial division is cheap next to the sieve.
+#define SIQSSLACK 13
+
+// siqs() collects this many relations more than there are primes, which
+// makes at least as many dependencies among them.
+#define SIQSEXTRA 64
+
+// A has at most this many prime factors, taken from this many either
+// side of the prime of the right size.
+#define SIQSMAXA 20
+#define SIQSWINDOW 30
+
+// The size of the factor base, the size of the sieve interval in blocks
+// and the large prime bound as a multiple of the biggest prime in the
+// factor base, by the number of bits being factored.  Sizes in between
+// are interpolated.
+//
+static const struct
+{
+	long bits;
+	long primes;
+	long blocks;
+	long large;
+} siqs_params[] = {
+	{ 100, 250, 2, 30 },
+	{ 128, 500, 2, 40 },
+	{ 150, 1000, 2, 40 },
+	{ 183, 2500, 2, 50 },
+	{ 200, 4500, 2, 60 },
+	{ 216, 7000, 2, 80 },
+	{ 249, 12000, 4, 100 },
+	{ 266, 16000, 4, 100 },
+	{ 283, 20000, 4, 100 },
+	{ 298, 25000, 6, 120 },
+	{ 333, 32000, 8, 150 },
+};
+#define SIQSPARAMS ((long)(sizeof(siqs_params) / sizeof(siqs_params[0])))
+
+// Odd squarefree multipliers to choose k from.
+//
+static const uint8_t siqs_multipliers[] = {
+	1, 3, 5, 7, 11, 13, 15, 17, 19, 21, 23, 29, 31, 33, 35, 37, 39, 41,
+	43, 47, 51, 53, 55, 57, 59, 61, 65, 67, 69, 71, 73, 77, 79, 83, 85,
+	87, 89, 91, 93, 95, 97
+};
+
+// Word arithmetic mod a prime below 2^32.
+//
+static inline uint32_t mulmod_word(uint32_t a, uint32_t b, uint32_t p)
+{
+	return (uint32_t)((uint64_t)a * b % p);
+}
+
+static uint32_t powmod_word(uint32_t b, uint32_t e, uint32_t p)
+{
+	uint32_t result = 1 % p;
+	for (; e; e>>=1)
+	{
+		if (e & 1)
+			result = mulmod_word(result, b, p);
+		b = mulmod_word(b, b, p);
+	}
+	return result;
+}
+
+// 1/a mod p, for a not 0 mod p.
+static uint32_t invmod_word(uint32_t a, uint32_t p)
+{
+	int64_t r0 = p, r1 = a % p;
+	int64_t t0 = 0, t1 = 1;
+	while (r1)
+	{
+		int64_t q = r0 / r1;
+		int64_t r = r0 - q*r1;
+		r0 = r1;
+		r1 = r;
+		int64_t t = t0 - q*t1;
+		t0 = t1;
+		t1 = t;
+	}
+	return (uint32_t)(t0 < 0 ? t0 + p : t0);
+}
+
+// A square root of a mod the odd prime p, for a square a, by Tonelli and
+// Shanks.
+static uint32_t sqrtmod_word(uint32_t a, uint32_t p)
+{
+	a %= p;
+	if (a == 0)
+		return 0;
+	if ((p & 3) == 3)
+		return powmod_word(a, (p + 1) / 4, p);
+
+	uint32_t q = p - 1;
+	int s = 0;
+	for (; !(q & 1); q>>=1)
+		s++;
+	uint32_t z = 2;
+	while (jacobi_word(z, p) != -1)
+		z++;
+	uint32_t c = powmod_word(z, q, p);
+	uint32_t x = powmod_word(a, (q + 1) / 2, p);
+	uint32_t t = powmod_word(a, q, p);
+	int m = s;
+	while (t != 1)
+	{
+		int i = 0;
+		for (uint32_t t2=t; t2!=1; t2=mulmod_word(t2, t2, p))
+			i++;
+		uint32_t b = c;
+		for (int j=0; j<m-i-1; j++)
+			b = mulmod_word(b, b, p);
+		x = mulmod_word(x, b, p);
+		c = mulmod_word(b, b, p);
+		t = mulmod_word(t, c, p);
+		m = i;
+	}
+	return x;
+}
+
+// A relation Y^2 = product of factors times large^2 mod N.  The factors
+// are indices into the factor base, in order and as many times as they
+// divide, with 0 for -1.  A partial has its lone large prime in large,
+// not squared.
+//
+template <typename Digit, typename TwoDigits>
+struct SiqsRelation
+{
+	BasicBigInt<Digit, TwoDigits> y;
+	int* factors;
+	int count;
+	uint32_t large;
+};
+
+// What the threads working on one siqs() share.  The lock covers family
+// and all the relations.
+//
+template <typename Digit, typename TwoDigits>
+struct SiqsJob
+{
+	BasicBigInt<Digit, TwoDigits> n;
+	BasicBigInt<Digit, TwoDigits> kn;
+	BasicBigInt<Digit, TwoDigits> target;	// A should be about this
+	long primes;							// in the factor base, from 1
+	uint32_t* prime;						// prime[0] stands for -1
+	uint32_t* root;							// sqrt(kN) mod prime
+	unsigned char* logp;
+	long small;								// the first one sieved with
+	long window_low, window_high;			// where A's primes come from
+	int s;
+	long half;								// M
+	int threshold;
+	uint32_t large;
+
+	long family;							// the next A to use
+	long needed;
+	SiqsRelation<Digit, TwoDigits>* relations;
+	long count, capacity;
+	SiqsRelation<Digit, TwoDigits>* partials;
+	long partial_count, partial_capacity;
+	long* partial_hash;						// index + 1, by large prime
+	long hash_size;
+#if HAVE_PTHREAD
+	pthread_mutex_t lock;
+#endif
+};
+
+// Append a relation made from one or two lists of factors, merging them
+// in order.
+//
+template <typename Digit, typename TwoDigits>
+static void siqs_store(SiqsRelation<Digit, TwoDigits>** list, long* count, long* capacity,
+					   const BasicBigInt<Digit, TwoDigits>& y, const int* factors, int length,
+					   const int* more, int more_length, uint32_t large)
+{
+	if (*count == *capacity)
+	{
+		long grown = *capacity ? 2 * *capacity : 256;
+		SiqsRelation<Digit, TwoDigits>* bigger = new SiqsRelation<Digit, TwoDigits>[grown];
+		for (long i=0; i<*count; i++)
+			bigger[i] = (*list)[i];
+		delete[] *list;
+		*list = bigger;
+		*capacity = grown;
+	}
+
+	SiqsRelation<Digit, TwoDigits>* r = &(*list)[(*count)++];
+	r->y = y;
+	r->count = length + more_length;
+	r->factors = new int[r->count];
+	r->large = large;
+	int i = 0, j = 0, k = 0;
+	while (i < length || j < more_length)
+		if (j == more_length || (i < length && factors[i] <= more[j]))
+			r->factors[k++] = factors[i++];
+		else
+			r->factors[k++] = more[j++];
+}
+
+// Add a relation found by a worker, or a partial one with the large prime
+// left over, pairing it with an earlier partial if there is one.
+//
+template <typename Digit, typename TwoDigits>
+static void siqs_add(SiqsJob<Digit, TwoDigits>* job, const BasicBigInt<Digit, TwoDigits>& y,
+					 const int* factors, int length, uint32_t large)
+{
+	FACTOR_LOCK(job);
+	if (large == 1)
+	{
+		siqs_store(&job->relations, &job->count, &job->capacity, y, factors, length, NULL, 0, 1);
+		FACTOR_UNLOCK(job);
+		return;
+	}
+
+	long mask = job->hash_size - 1;
+	long h;
+	for (h=(large * 2654435761u) & mask; job->partial_hash[h]; h=(h+1) & mask)
+	{
+		SiqsRelation<Digit, TwoDigits>* other = &job->partials[job->partial_hash[h]-1];
+		if (other->large == large)
+		{
+			if (other->y != y)
+				siqs_store(&job->relations, &job->count, &job->capacity, y * other->y % job->n,
+						   factors, length, other->factors, other->count, large);
+			FACTOR_UNLOCK(job);
+			return;
+		}
+	}
+	siqs_store(&job->partials, &job->partial_count, &job->partial_capacity, y, factors, length, NULL, 0, large);
+	job->partial_hash[h] = job->partial_count;
+
+	if (2*job->partial_count > job->hash_size)
+	{
+		delete[] job->partial_hash;
+		job->hash_size *= 2;
+		mask = job->hash_size - 1;
+		job->partial_hash = new long[job->hash_size];
+		memset(job->partial_hash, 0, job->hash_size*sizeof(long));
+		for (long i=0; i<job->partial_count; i++)
+		{
+			for (h=(job->partials[i].large * 2654435761u) & mask; job->partial_hash[h]; h=(h+1) & mask)
+				;
+			job->partial_hash[h] = i + 1;
+		}
+	}
+	FACTOR_UNLOCK(job);
+}
+
+// Find sets of relations whose exponents are all even, by Gauss-Jordan
+// elimination on a bit matrix with a row for each prime and a column for
+// each relation, and try each until one gives a factor.  Relations with
+// a prime that no other relation has an odd power of can't be in any
+// set, so they're dropped first, over and over until none are left.
+//
+template <typename Digit, typename TwoDigits>
+static bool siqs_solve(SiqsJob<Digit, TwoDigits>* job, BasicBigInt<Digit, TwoDigits>* factor)
+{
+	typedef BasicBigInt<Digit, TwoDigits> BigNum;
+	long columns = job->primes + 1;
+	long count = job->count;
+	SiqsRelation<Digit, TwoDigits>* relations = job->relations;
+
+	// Each relation's primes to an odd power
+	int** odd = new int*[count];
+	int* odd_count = new int[count];
+	long* weight = new long[columns];
+	bool* active = new bool[count];
+	memset(weight, 0, columns*sizeof(long));
+	for (long r=0; r<count; r++)
+	{
+		odd[r] = new int[relations[r].count];
+		odd_count[r] = 0;
+		for (int i=0; i<relations[r].count; )
+		{
+			int j = i;
+			while (j < relations[r].count && relations[r].factors[j] == relations[r].factors[i])
+				j++;
+			if ((j - i) & 1)
+			{
+				odd[r][odd_count[r]++] = relations[r].factors[i];
+				weight[relations[r].factors[i]]++;
+			}
+			i = j;
+		}
+		active[r] = true;
+	}
+	for (bool dropped=true; dropped; )
+	{
+		dropped = false;
+		for (long r=0; r<count; r++)
+		{
+			if (!active[r])
+				continue;
+			int i;
+			for (i=0; i<odd_count[r] && weight[odd[r][i]] > 1; i++)
+				;
+			if (i < odd_count[r])
+			{
+				active[r] = false;
+				for (i=0; i<odd_count[r]; i++)
+					weight[odd[r][i]]--;
+				dropped = true;
+			}
+		}
+	}
+
+	// Number the primes and relations that are left
+	long* row_of = new long[columns];
+	long rows = 0;
+	for (long c=0; c<columns; c++)
+		row_of[c] = weight[c] ? rows++ : -1;
+	long* relation_of = new long[count];
+	long width = 0;
+	for (long r=0; r<count; r++)
+		if (active[r])
+			relation_of[width++] = r;
+	long words = (width + 63) / 64;
+
+	uint64_t* matrix = new uint64_t[rows*words + 1];
+	memset(matrix, 0, (rows*words + 1)*sizeof(uint64_t));
+	for (long c=0; c<width; c++)
+	{
+		long r = relation_of[c];
+		for (int i=0; i<odd_count[r]; i++)
+			matrix[row_of[odd[r][i]]*words + c/64] |= (uint64_t)1 << (c % 64);
+	}
+
+	long* pivot = new long[rows + 1];
+	long rank = 0;
+	for (long c=0; c<width && rank<rows; c++)
+	{
+		uint64_t bit = (uint64_t)1 << (c % 64);
+		long i;
+		for (i=rank; i<rows && !(matrix[i*words + c/64] & bit); i++)
+			;
+		if (i == rows)
+			continue;
+		if (i != rank)
+			for (long w=0; w<words; w++)
+			{
+				uint64_t swap = matrix[i*words + w];
+				matrix[i*words + w] = matrix[rank*words + w];
+				matrix[rank*words + w] = swap;
+			}
+		uint64_t* pivot_row = &matrix[rank*words];
+		for (i=0; i<rows; i++)
+			if (i != rank && (matrix[i*words + c/64] & bit))
+			{
+				uint64_t* row = &matrix[i*words];
+				for (long w=0; w<words; w++)
+					row[w] ^= pivot_row[w];
+			}
+		pivot[rank++] = c;
+	}
 
+	// Each column without a pivot makes a dependency with the pivot
+	// columns whose rows have its bit set
+	bool found = false;
+	long* exponent = new long[columns];
+	long next = 0;
+	for (long f=0; f<width && !found; f++)
+	{
+		if (next < rank && pivot[next] == f)
+		{
+			next++;
+			continue;
+		}
+		memset(exponent, 0, columns*sizeof(long));
+		BigNum x = 1L;
+		BigNum z = 1L;
+		for (long i=-1; i<rank; i++)
+		{
+			if (i >= 0 && !(matrix[i*words + f/64] & ((uint64_t)1 << (f % 64))))
+				continue;
+			SiqsRelation<Digit, TwoDigits>* r = &relations[relation_of[i < 0 ? f : pivot[i]]];
+			x = x * r->y % job->n;
+			if (r->large != 1)
+				z = z * (long)r->large % job->n;
+			for (int j=0; j<r->count; j++)
+				exponent[r->factors[j]]++;
+		}
+		for (long c=1; c<columns; c++)
+			for (long e=0; e<exponent[c]/2; e++)
+			{
+				z *= (long)job->prime[c];
+				if (z.num_bits() > 2*job->n.num_bits())
+					z %= job->n;
+			}
+		BigNum difference = (x - z) % job->n;
+		BigNum g = difference.gcd(job->n);
+		if (!g.one() && g != job->n)
+		{
+			*factor = g;
+			found = true;
+		}
+	}
 
-// GCD
+	delete[] exponent;
+	delete[] pivot;
+	delete[] matrix;
+	delete[] relation_of;
+	delete[] row_of;
+	delete[] active;
+	delete[] weight;
+	delete[] odd_count;
+	for (long r=0; r<count; r++)
+		delete[] odd[r];
+	delete[] odd;
+	return found;
+}
 
-// This function returns the greatest common divisor of this BigInt and
-// the given BigInt.
+// Look for a factor of the magnitude with the self-initializing quadratic
+// sieve.  Returns true with a factor other than 1 and the number itself
+// (not necessarily prime) in *factor, or false if the number is prime or
+// too small to have a factor.  The time taken depends on the size of the
+// number rather than of its factors: below SIQSMINBITS rho is used
+// instead, and the sieve is best from around 40 digits up to 100.
 //
-BigInt BigInt::gcd(const BigInt& bi) const
+// Relations are collected by as many threads as there are processors.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::siqs(BasicBigInt* factor) const
 {
-	// If the given value is zero, return the absolute value of this
-	//
-	if (bi.zero())
+	BasicBigInt n = *this;
+	n.negative = false;
+	if (n < 4L)
+		return false;
+	if (n.even())
 	{
-		BigInt result = *this;
-		result.negative = false;
-		return result;
+		*factor = 2L;
+		return true;
+	}
+	if (n.is_probable_prime(0))
+		return false;
+	BasicBigInt base;
+	unsigned long exponent;
+	if (n.is_perfect_power(&base, &exponent))
+	{
+		*factor = base;
+		return true;
+	}
+	long bits = n.num_bits();
+	if (bits < SIQSMINBITS)
+	{
+		for (LIMB c=1; ; c++)
+		{
+			*factor = pollard_brent(n, c, 0);
+			if (*factor != n)
+				return true;
+		}
 	}
 
-	// Make a copy of each which we can manipulate.
-	//
-	BigInt val1 = *this;
-	BigInt val2 = bi;
+	long at;
+	for (at=1; at<SIQSPARAMS-1 && siqs_params[at].bits < bits; at++)
+		;
+	long span = siqs_params[at].bits - siqs_params[at-1].bits;
+	long into = (bits < siqs_params[at].bits) ? bits - siqs_params[at-1].bits : span;
+	long primes = siqs_params[at-1].primes + (siqs_params[at].primes - siqs_params[at-1].primes) * into / span;
+	long large = siqs_params[at-1].large + (siqs_params[at].large - siqs_params[at-1].large) * into / span;
+	long blocks = (into < span) ? siqs_params[at-1].blocks : siqs_params[at].blocks;
+
+	// Knuth and Schroeppel's choice of multiplier, for the most small
+	// primes in the factor base
+	uint32_t residue[SMALLPRIMES];
+	for (long i=0; i<SMALLPRIMES; i++)
+		residue[i] = n.mod_word(small_primes[i]);
+	uint32_t k = 1;
+	double best = 0;
+	for (size_t m=0; m<sizeof(siqs_multipliers); m++)
+	{
+		uint32_t multiplier = siqs_multipliers[m];
+		double score = -0.5 * log((double)multiplier);
+		switch ((multiplier * n.mod_word(8)) % 8)
+		{
+		case 1: score += 2 * log(2.0); break;
+		case 5: score += log(2.0); break;
+		default: score += 0.5 * log(2.0); break;
+		}
+		for (long i=0; i<SMALLPRIMES; i++)
+		{
+			uint32_t p = small_primes[i];
+			if (multiplier % p == 0)
+				score += log((double)p) / p;
+			else if (jacobi_word((uint64_t)residue[i] * multiplier, p) == 1)
+				score += 2 * log((double)p) / (p - 1);
+		}
+		if (m == 0 || score > best)
+		{
+			best = score;
+			k = multiplier;
+		}
+	}
 
-	// Find GCD by repeated modulation
-	//
-	while (!val2.zero())
+	SiqsJob<Digit, TwoDigits> job;
+	job.n = n;
+	job.kn = n * (long)k;
+	job.primes = primes;
+	job.prime = new uint32_t[primes + 1];
+	job.root = new uint32_t[primes + 1];
+	job.logp = new unsigned char[primes + 1];
+	job.prime[0] = 1;
+	job.root[0] = 0;
+	job.logp[0] = 0;
+	job.prime[1] = 2;
+	job.root[1] = 1;
+	job.logp[1] = 1;
+
+	// The factor base, from the odd primes up to a limit that grows
+	// until there are enough
+	long have = 1;
+	for (uint32_t low=3, limit=(uint32_t)(primes*32 + 1024); have<primes; low=limit, limit*=2)
 	{
-		val1 %= val2;
-		if (val1.zero())
-			break;
-		val2 %= val1;
+		unsigned char* composite = new unsigned char[limit];
+		memset(composite, 0, limit);
+		for (uint32_t i=3; i<=limit/i; i+=2)
+			for (uint32_t multiple=i*i; multiple<limit; multiple+=2*i)
+				composite[multiple] = 1;
+		for (uint32_t p=low|1; p<limit && have<primes; p+=2)
+		{
+			if (composite[p])
+				continue;
+			uint32_t r = n.mod_word(p);
+			if (r == 0)
+			{
+				delete[] composite;
+				delete[] job.prime;
+				delete[] job.root;
+				delete[] job.logp;
+				*factor = (long)p;
+				return true;
+			}
+			r = mulmod_word(r, k % p, p);
+			if (r != 0 && jacobi_word(r, p) != 1)
+				continue;
+			have++;
+			job.prime[have] = p;
+			job.root[have] = sqrtmod_word(r, p);
+			job.logp[have] = (unsigned char)(log((double)p) / log(2.0) + 0.5);
+		}
+		delete[] composite;
+	}
+	for (job.small=2; job.small<primes && job.prime[job.small]<SIQSSMALL; job.small++)
+		;
+
+	job.half = blocks * SIQSBLOCK / 2;
+	uint64_t bound = (uint64_t)job.prime[primes] * large;
+	job.large = (bound < 0xffffffffu) ? (uint32_t)bound : 0xffffffffu;
+	job.target = (job.kn * 2L).isqrt() / job.half;
+
+	// g(x) is up to about M sqrt(kN/2), and a relation with a large prime
+	// gets that much less from the sieve
+	BasicBigInt top = job.kn;
+	top >>= job.kn.num_bits() - 32;
+	double log2_kn = job.kn.num_bits() - 32 + log((double)top.ul_value()) / log(2.0);
+	double log2_g = log((double)job.half) / log(2.0) + log2_kn / 2 - 0.5;
+	job.threshold = (int)(log2_g - log((double)job.large) / log(2.0) - SIQSSLACK);
+
+	// s primes of about the same size make A, preferring them near 2000
+	long target_bits = job.target.num_bits();
+	double prime_bits = log((double)job.prime[primes*2/3]) / log(2.0);
+	if (prime_bits > 11)
+		prime_bits = 11;
+	int s = (int)(target_bits / prime_bits + 0.5);
+	if (s < 2)
+		s = 2;
+	if (s > SIQSMAXA)
+		s = SIQSMAXA;
+	job.s = s;
+	double want = pow(2.0, (double)target_bits / s);
+	long center;
+	for (center=job.small; center<primes && job.prime[center]<want; center++)
+		;
+	job.window_low = (center - SIQSWINDOW > job.small) ? center - SIQSWINDOW : job.small;
+	job.window_high = (center + SIQSWINDOW < primes) ? center + SIQSWINDOW : primes;
+	if (job.window_high - job.window_low < 2*s)
+	{
+		job.window_low = job.small;
+		job.window_high = primes;
 	}
 
-	if (val1.zero())
-		return val2;
-	else
-		return val1;
+	job.family = 0;
+	job.needed = primes + 1 + SIQSEXTRA;
+	job.relations = NULL;
+	job.count = job.capacity = 0;
+	job.partials = NULL;
+	job.partial_count = job.partial_capacity = 0;
+	job.hash_size = 1024;
+	job.partial_hash = new long[job.hash_size];
+	memset(job.partial_hash, 0, job.hash_size*sizeof(long));
+
+#if HAVE_PTHREAD
+	pthread_mutex_init(&job.lock, NULL);
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t* workers = (threads > 1) ? new pthread_t[threads-1] : NULL;
+	long started;
+	for (started=0; started<threads-1; started++)
+		if (pthread_create(&workers[started], NULL, siqs_worker, &job))
+			break;
+	siqs_worker(&job);
+	for (long i=0; i<started; i++)
+		pthread_join(workers[i], NULL);
+	delete[] workers;
+	pthread_mutex_destroy(&job.lock);
+#else
+	siqs_worker(&job);
+#endif
+
+	bool found = siqs_solve(&job, factor);
+
+	for (long i=0; i<job.count; i++)
+		delete[] job.relations[i].factors;
+	for (long i=0; i<job.partial_count; i++)
+		delete[] job.partials[i].factors;
+	delete[] job.relations;
+	delete[] job.partials;
+	delete[] job.partial_hash;
+	delete[] job.prime;
+	delete[] job.root;
+	delete[] job.logp;
+	return found;
 }
 
+// Sieve polynomials for siqs() until there are enough relations, on one
+// of its threads.
+template <typename Digit, typename TwoDigits>
+void* BasicBigInt<Digit, TwoDigits>::siqs_worker(void* context)
+{
+	SiqsJob<Digit, TwoDigits>* job = (SiqsJob<Digit, TwoDigits>*)context;
+	long primes = job->primes;
+	int s = job->s;
+	long size = 2 * job->half;
+
+	unsigned char* sieve = new unsigned char[SIQSBLOCK];
+	uint32_t* work = new uint32_t[(5 + s)*(primes + 1)];
+	uint32_t* ainv = work;
+	uint32_t* root1 = &work[primes + 1];
+	uint32_t* root2 = &work[2*(primes + 1)];
+	uint32_t* next1 = &work[3*(primes + 1)];
+	uint32_t* next2 = &work[4*(primes + 1)];
+	uint32_t* bainv = &work[5*(primes + 1)];	// by l, for l from 1
+	int* factors = new int[job->kn.num_bits() + SIQSMAXA + 64];
+
+	BasicBigInt A, B, C, twice, value;
+	BasicBigInt part[SIQSMAXA];
+	long q[SIQSMAXA];
+	int sign[SIQSMAXA];
+
+	for (;;)
+	{
+		FACTOR_LOCK(job);
+		bool enough = (job->count >= job->needed);
+		long family = job->family++;
+		FACTOR_UNLOCK(job);
+		if (enough)
+			break;
+
+		// s - 1 primes at random from the window, and the one that brings
+		// A closest to the target
+		uint64_t random = (uint64_t)family * 0x9e3779b97f4a7c15ULL + 0x2545f4914f6cdd1dULL;
+		long window = job->window_high - job->window_low;
+		for (;;)
+		{
+			A = 1L;
+			int chosen = 0;
+			while (chosen < s-1)
+			{
+				random ^= random >> 12;
+				random ^= random << 25;
+				random ^= random >> 27;
+				long pick = job->window_low + (long)((random * 2685821657736338717ULL >> 33) % window);
+				int i;
+				for (i=0; i<chosen && q[i]!=pick; i++)
+					;
+				if (i == chosen)
+				{
+					q[chosen++] = pick;
+					A *= (long)job->prime[pick];
+				}
+			}
+			BasicBigInt rest = job->target / A;
+			long last = job->small;
+			if (rest.num_bits() < 32)
+			{
+				uint32_t want = (uint32_t)rest.ul_value();
+				long low = job->small, high = primes;
+				while (low < high)
+				{
+					long middle = (low + high) / 2;
+					if (job->prime[middle] < want)
+						low = middle + 1;
+					else
+						high = middle;
+				}
+				last = low;
+				if (last > job->small && job->prime[last] > want &&
+					want - job->prime[last-1] < job->prime[last] - want)
+					last--;
+			}
+			else
+				last = primes;
+			int i;
+			for (i=0; i<chosen && q[i]!=last; i++)
+				;
+			if (i == chosen)
+			{
+				q[s-1] = last;
+				A *= (long)job->prime[last];
+				break;
+			}
+		}
 
+		// B = the sum of part[l], each a multiple of A/q[l] with part[l]^2
+		// = kN mod q[l], so B^2 = kN mod A
+		B = 0L;
+		for (int l=0; l<s; l++)
+		{
+			uint32_t p = job->prime[q[l]];
+			part[l] = A;
+			part[l].divmod_word(p);
+			uint32_t gamma = mulmod_word(job->root[q[l]], invmod_word(part[l].mod_word(p), p), p);
+			if (gamma > p/2)
+				gamma = p - gamma;
+			part[l] *= (long)gamma;
+			B += part[l];
+			sign[l] = 1;
+		}
 
-// Comparison
+		// The roots of g mod each prime, as offsets into the interval
+		for (long i=2; i<=primes; i++)
+		{
+			uint32_t p = job->prime[i];
+			ainv[i] = 0;
+			int l;
+			for (l=0; l<s && q[l]!=i; l++)
+				;
+			if (l < s)
+				continue;
+			uint32_t inverse = invmod_word(A.mod_word(p), p);
+			uint32_t b = B.mod_word(p);
+			uint32_t t = job->root[i];
+			uint32_t shift = (uint32_t)(job->half % p);
+			ainv[i] = inverse;
+			root1[i] = (mulmod_word(inverse, (t + p - b) % p, p) + shift) % p;
+			root2[i] = (mulmod_word(inverse, (2*p - t - b) % p, p) + shift) % p;
+			for (l=1; l<s; l++)
+				bainv[(l-1)*(primes + 1) + i] = mulmod_word(2 * part[l].mod_word(p) % p, inverse, p);
+		}
 
-// This operator handles expressions of the form:
-//
-//	long == BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
-//
-bool operator==(long value, const BigInt& bi)
-{
-	return bi == value;
+		for (long polynomial=0; polynomial < (1L << (s-1)); polynomial++)
+		{
+			if (polynomial)
+			{
+				int l = trailing_zeros(polynomial) + 1;
+				const uint32_t* delta = &bainv[(l-1)*(primes + 1)];
+				BasicBigInt step = part[l] * 2L;
+				if (sign[l] > 0)
+				{
+					B -= step;
+					for (long i=2; i<=primes; i++)
+						if (ainv[i])
+						{
+							uint32_t p = job->prime[i];
+							root1[i] += delta[i];
+							if (root1[i] >= p)
+								root1[i] -= p;
+							root2[i] += delta[i];
+							if (root2[i] >= p)
+								root2[i] -= p;
+						}
+				}
+				else
+				{
+					B += step;
+					for (long i=2; i<=primes; i++)
+						if (ainv[i])
+						{
+							uint32_t p = job->prime[i];
+							root1[i] += p - delta[i];
+							if (root1[i] >= p)
+								root1[i] -= p;
+							root2[i] += p - delta[i];
+							if (root2[i] >= p)
+								root2[i] -= p;
+						}
+				}
+				sign[l] = -sign[l];
+			}
+			C = B*B - job->kn;
+			C.divexact(A);
+			twice = B * 2L;
+
+			for (long i=2; i<=primes; i++)
+			{
+				next1[i] = root1[i];
+				next2[i] = root2[i];
+			}
+			for (long start=0; start<size; start+=SIQSBLOCK)
+			{
+				uint32_t end = (uint32_t)(start + SIQSBLOCK);
+				memset(sieve, 0, SIQSBLOCK);
+				for (long i=job->small; i<=primes; i++)
+				{
+					if (!ainv[i])
+						continue;
+					uint32_t p = job->prime[i];
+					unsigned char logp = job->logp[i];
+					uint32_t position;
+					for (position=next1[i]; position<end; position+=p)
+						sieve[position - start] += logp;
+					next1[i] = position;
+					if (root2[i] == root1[i])
+						continue;
+					for (position=next2[i]; position<end; position+=p)
+						sieve[position - start] += logp;
+					next2[i] = position;
+				}
+
+				for (long j=0; j<SIQSBLOCK; j++)
+				{
+					if (sieve[j] < job->threshold)
+						continue;
+					long index = start + j;
+					long x = index - job->half;
+					value = A * x;
+					value += twice;
+					value *= x;
+					value += C;
+					if (value.zero())
+						continue;
+
+					int length = 0;
+					if (value.is_negative())
+					{
+						factors[length++] = 0;
+						value.negate();
+					}
+					unsigned long twos = value.ctz();
+					value >>= twos;
+					for (unsigned long t=0; t<twos; t++)
+						factors[length++] = 1;
+					for (long i=2; i<=primes; i++)
+					{
+						uint32_t p = job->prime[i];
+						if (!ainv[i])
+							factors[length++] = (int)i;
+						else if (index % p != root1[i] && index % p != root2[i])
+							continue;
+						while (value.mod_word(p) == 0)
+						{
+							value.divmod_word(p);
+							factors[length++] = (int)i;
+						}
+					}
+
+					uint32_t leftover = 1;
+					if (!value.one())
+					{
+						if (value.num_bits() > 32 || value.ul_value() > job->large)
+							continue;
+						leftover = (uint32_t)value.ul_value();
+					}
+					siqs_add(job, (A * x + B) % job->n, factors, length, leftover);
+				}
+			}
+
+			FACTOR_LOCK(job);
+			bool enough = (job->count >= job->needed);
+			FACTOR_UNLOCK(job);
+			if (enough)
+				break;
+		}
+	}
+
+	delete[] factors;
+	delete[] work;
+	delete[] sieve;
+	return NULL;
 }
 
+
+// Comparison
+
 // This operator handles expressions of the form:
 //
 //	BigInt == (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator==(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator==(const BasicBigInt& bi) const
 {
 	// If different signs, can't be equal
 	//
@@ -1495,42 +5152,22 @@ bool BigInt::operator==(const BigInt& bi) const
 	return value_compare(bi) == 0;
 }
 
-// This operator handles expressions of the form:
-//
-//	long != BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
-//
-bool operator!=(long value, const BigInt& bi)
-{
-	return !(value == bi);
-}
-
 // This operator handles expressions of the form:
 //
 //	BigInt != (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator!=(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator!=(const BasicBigInt& bi) const
 {
 	return !(*this == bi);
 }
 
-// This operator handles expressions of the form:
-//
-//	long < BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
-//
-bool operator<(long value, const BigInt& bi)
-{
-	return bi > value;
-}
-
 // This operator handles expressions of the form:
 //
 //	BigInt < (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator<(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator<(const BasicBigInt& bi) const
 {
 	// If negative and bi isn't, must be less than
 	//
@@ -1556,22 +5193,12 @@ bool BigInt::operator<(const BigInt& bi) const
 	return false;	// never happens, just quieting the compiler
 }
 
-// This operator handles expressions of the form:
-//
-//	long <= BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
-//
-bool operator<=(long value, const BigInt& bi)
-{
-	return bi >= value;
-}
-
 // This operator handles expressions of the form:
 //
 //	BigInt <= (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator<=(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator<=(const BasicBigInt& bi) const
 {
 	// If negative and bi isn't, must be less than (or equal)
 	//
@@ -1597,56 +5224,38 @@ bool BigInt::operator<=(const BigInt& bi) const
 	return false;	// never happens, just quieting the compiler
 }
 
-// This operator handles expressions of the form:
-//
-//	long > BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
-//
-bool operator>(long value, const BigInt& bi)
-{
-	return bi < value;
-}
-
 // This operator handles expressions of the form:
 //
 //	BigInt > (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator>(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator>(const BasicBigInt& bi) const
 {
 	return !(*this <= bi);
 }
 
-// This operator handles expressions of the form:
-//
-//	long >= BigInt
-//
-// NOTE: This function is not a method of this class, we're just friends
-//
-bool operator>=(long value, const BigInt& bi)
-{
-	return bi <= value;
-}
-
 // This operator handles expressions of the form:
 //
 //	BigInt >= (anything from which a BigInt can be constructed)
 //
-bool BigInt::operator>=(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator>=(const BasicBigInt& bi) const
 {
 	return !(*this < bi);
 }
 
 // This function returns true if this BigInt is greater than zero.
 //
-bool BigInt::is_positive() const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::is_positive() const
 {
 	return (!zero() && !negative);
 }
 
 // This function returns true if this BigInt is less than zero.
 //
-bool BigInt::is_negative() const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::is_negative() const
 {
 	return (!zero() && negative);
 }
@@ -1655,35 +5264,40 @@ bool BigInt::is_negative() const
 // Note: We're not distinguishing between positive and negative zero.
 // There are places in the code that rely on this fact.
 //
-bool BigInt::zero() const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::zero() const
 {
 	return (msd==lsd && value[lsd]==0);
 }
 
 // This function returns true if this BigInt is equal to one.
 //
-bool BigInt::one() const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::one() const
 {
 	return (msd==lsd && value[lsd]==1 && !negative);
 }
 
 // This function returns true if this BigInt is equal to negative one.
 //
-bool BigInt::negative_one() const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::negative_one() const
 {
 	return (msd==lsd && value[lsd]==1 && negative);
 }
 
 // This function returns true if this BigInt is even.
 //
-bool BigInt::even() const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::even() const
 {
 	return !(value[lsd] & 1);	// Only need to check the lsd
 }
 
 // This function returns true if this BigInt is odd.
 //
-bool BigInt::odd() const
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::odd() const
 {
 	return (value[lsd] & 1);	// Only need to check the lsd
 }
@@ -1691,7 +5305,8 @@ bool BigInt::odd() const
 // Return -1 if this value is less than the given value, 0 if equal, and 
 // 1 if greater, regardless of sign.
 //
-int BigInt::value_compare(const BigInt& bi) const
+template <typename Digit, typename TwoDigits>
+int BasicBigInt<Digit, TwoDigits>::value_compare(const BasicBigInt& bi) const
 {
 	// If shorter, must be less
 	//
@@ -1718,6 +5333,22 @@ int BigInt::value_compare(const BigInt& bi) const
 	return 0;
 }
 
+// If the magnitude fits in a word, store it in *word and return true.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::word_value(uint32_t* word) const
+{
+	uint64_t result = 0;
+	for (long i=msd; i<=lsd; i++)
+	{
+		result = (result << DIGITBITS) | value[i];
+		if (result >> WORDBITS)
+			return false;
+	}
+	*word = (uint32_t)result;
+	return true;
+}
+
 
 
 // Shifting
@@ -1726,8 +5357,11 @@ int BigInt::value_compare(const BigInt& bi) const
 //
 //	BigInt <<= long
 //
-bool BigInt::operator<<=(long howmany)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator<<=(long howmany)
 {
+	uncache();
+	unshare();
 	// If only shifting one, use faster algorithm
 	//
 	if (howmany == 1)
@@ -1751,8 +5385,10 @@ bool BigInt::operator<<=(long howmany)
 	long digits = howmany / DIGITBITS;
 	unsigned char bits = (unsigned char) (howmany % DIGITBITS);
 
+	// A whole number of digits needs no mask, and shifting by the full
+	// width of a digit to make one would be undefined
 	unsigned char bitsc = DIGITBITS - bits;
-	DIGIT himask = DIGITMASK << bitsc;
+	DIGIT himask = bits ? (DIGIT)(DIGITMASK << bitsc) : 0;
 
 	// Extend value array
 	//
@@ -1790,8 +5426,10 @@ bool BigInt::operator<<=(long howmany)
 
 // Special case of <<=, shifts one bit.
 //
-bool BigInt::shift_left_one()
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::shift_left_one()
 {
+	unshare();
 	// If zero, no amount of shifting will change that
 	//
 	if (zero())
@@ -1820,8 +5458,11 @@ bool BigInt::shift_left_one()
 //
 //	BigInt >>= long
 //
-bool BigInt::operator>>=(long howmany)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator>>=(long howmany)
 {
+	uncache();
+	unshare();
 	// If zero, no amount of shifting will change that
 	//
 	if (zero())
@@ -1855,31 +5496,237 @@ bool BigInt::operator>>=(long howmany)
 		msd += digits;
 	}
 
-	if (bits)
-	{
-		unsigned char bitsc = DIGITBITS - bits;
-		DIGIT lomask = DIGITMASK >> bitsc;
+	if (bits)
+	{
+		unsigned char bitsc = DIGITBITS - bits;
+		DIGIT lomask = DIGITMASK >> bitsc;
+
+		// Do the shifting
+		for (long i=lsd; i>=msd; i--)
+		{
+			value[i] >>= bits;
+
+			// Copy the bottom bits from the digit to the left into the top
+			// of this digit
+			if (i > msd)
+				value[i] |= (value[i-1] & lomask) << bitsc;
+		}
+		if (msd<lsd && !value[msd])
+			++msd;
+	}
+
+	// If now zero, make sure negative is not set
+	//
+	if (zero())
+		negative = false;
+
+	return true;
+}
+
+
+
+// Bitwise operations
+
+// The bitwise operators treat values as two's complement with infinitely
+// many sign bits, as Python and GMP do: -1 is all ones, ~x is -x-1, and
+// x & -x is the lowest set bit of x.  The result is negative if the sign
+// bits come out set.
+//
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator&(const BasicBigInt& bi) const
+{
+	BasicBigInt result = *this;
+	result &= bi;
+	return result;
+}
+
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator|(const BasicBigInt& bi) const
+{
+	BasicBigInt result = *this;
+	result |= bi;
+	return result;
+}
+
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator^(const BasicBigInt& bi) const
+{
+	BasicBigInt result = *this;
+	result ^= bi;
+	return result;
+}
+
+template <typename Digit, typename TwoDigits>
+BasicBigInt<Digit, TwoDigits> BasicBigInt<Digit, TwoDigits>::operator~() const
+{
+	BasicBigInt result = *this;
+	result.complement();
+	return result;
+}
+
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator&=(const BasicBigInt& bi)
+{
+	return bitwise(bi, '&');
+}
+
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator|=(const BasicBigInt& bi)
+{
+	return bitwise(bi, '|');
+}
+
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::operator^=(const BasicBigInt& bi)
+{
+	return bitwise(bi, '^');
+}
+
+// Replace the value by its complement, -value-1.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::complement()
+{
+	negate();
+	return *this -= 1;
+}
+
+// Combine the value with bi's, a limb at a time, by the operator op ('&',
+// '|' or '^').  Both are packed into limbs one wider than the bigger of
+// them, so the top limb holds nothing but sign bits, and the negative ones
+// are negated there to make them two's complement.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::bitwise(const BasicBigInt& bi, char op)
+{
+	long count = limb_count();
+	if (bi.limb_count() > count)
+		count = bi.limb_count();
+	++count;
+
+	LIMB* a = new LIMB[2*count];
+	if (!a)  return false;
+	LIMB* b = a + count;
+
+	to_limbs(a, count);
+	if (negative)
+		negate_limbs(a, count);
+	bi.to_limbs(b, count);
+	if (bi.negative)
+		negate_limbs(b, count);
+
+	long k;
+	switch (op)
+	{
+		case '&':
+			for (k=0; k<count; k++)
+				a[k] &= b[k];
+			break;
+		case '|':
+			for (k=0; k<count; k++)
+				a[k] |= b[k];
+			break;
+		default:
+			for (k=0; k<count; k++)
+				a[k] ^= b[k];
+			break;
+	}
+
+	bool sign = (a[count-1] >> (LIMBBITS-1)) != 0;
+	if (sign)
+		negate_limbs(a, count);
+	bool ok = from_limbs(a, count, sign);
+	delete[] a;
+	return ok;
+}
+
+// Returns bit n of the value, in two's complement.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::testbit(unsigned long n) const
+{
+	long i = lsd - (long)(n / DIGITBITS);
+	bool bit = i >= msd && ((value[i] >> (n % DIGITBITS)) & 1);
+	if (!negative)
+		return bit;
+
+	// -m is ~(m-1), and subtracting one from m flips its bits up to the
+	// lowest one set, so bit n of -m is clear below that, set at it, and
+	// the complement of m's bit above it.
+	unsigned long low = ctz();
+	if (n < low)
+		return false;
+	if (n == low)
+		return true;
+	return !bit;
+}
+
+// Set or clear bit n of the value, in two's complement.  Non-negative
+// values just have the digit changed; negative ones go through the
+// bitwise operators.
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::setbit(unsigned long n)
+{
+	if (negative)
+	{
+		BasicBigInt bit = 1L;
+		return (bit <<= n) && (*this |= bit);
+	}
+
+	uncache();
+	unshare();
+	long i = lsd - (long)(n / DIGITBITS);
+	if (i < 0)
+	{
+		long more = -i;
+		if (!extend(more))
+			return false;
+		i += more;
+	}
+	value[i] |= (DIGIT)1 << (n % DIGITBITS);
+	if (i < msd)
+		msd = i;
+	return true;
+}
+
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::clearbit(unsigned long n)
+{
+	if (negative)
+	{
+		BasicBigInt bit = 1L;
+		return (bit <<= n) && bit.complement() && (*this &= bit);
+	}
+
+	long i = lsd - (long)(n / DIGITBITS);
+	if (i < msd)
+		return true;
 
-		// Do the shifting
-		for (long i=lsd; i>=msd; i--)
-		{
-			value[i] >>= bits;
+	uncache();
+	unshare();
+	value[i] &= ~((DIGIT)1 << (n % DIGITBITS));
+	while (msd < lsd && !value[msd])
+		++msd;
+	return true;
+}
 
-			// Copy the bottom bits from the digit to the left into the top
-			// of this digit
-			if (i > msd)
-				value[i] |= (value[i-1] & lomask) << bitsc;
-		}
-		if (msd<lsd && !value[msd])
-			++msd;
-	}
+// Returns the number of bits set in the magnitude.
+template <typename Digit, typename TwoDigits>
+unsigned long BasicBigInt<Digit, TwoDigits>::popcount() const
+{
+	unsigned long count = 0;
+	for (long i=msd; i<=lsd; i++)
+		count += ones(value[i]);
+	return count;
+}
 
-	// If now zero, make sure negative is not set
-	//
-	if (zero())
-		negative = false;
+// Returns the number of zero bits below the lowest one set, which is the
+// same for the value and its negation, or 0 if the value is zero.
+template <typename Digit, typename TwoDigits>
+unsigned long BasicBigInt<Digit, TwoDigits>::ctz() const
+{
+	for (long i=lsd; i>=msd; i--)
+		if (value[i] != 0)
+			return (unsigned long)(lsd-i)*DIGITBITS + trailing_zeros(value[i]);
 
-	return true;
+	return 0;
 }
 
 
@@ -1888,7 +5735,8 @@ bool BigInt::operator>>=(long howmany)
 
 // Returns the number of bytes needed by the value.
 //
-long BigInt::byte_length() const
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::byte_length() const
 {
 	long length = (lsd+1-msd)*DIGITBYTES;
 	for (DIGIT i=0xFF<<(8*(DIGITBYTES-1)); i && !(value[msd]&i) && length>1; i>>=8)
@@ -1898,14 +5746,16 @@ long BigInt::byte_length() const
 
 // Returns a newly-allocated byte array containing the value.
 //
-unsigned char* BigInt::byte_array_value() const
+template <typename Digit, typename TwoDigits>
+unsigned char* BasicBigInt<Digit, TwoDigits>::byte_array_value() const
 {
 	return byte_array_value(byte_length());
 }
 
 // Stores the value in the given byte array.
 //
-void BigInt::byte_array_value(unsigned char* result) const
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::byte_array_value(unsigned char* result) const
 {
 	byte_array_value(result, byte_length());
 }
@@ -1914,7 +5764,8 @@ void BigInt::byte_array_value(unsigned char* result) const
 // value.  If the length is not long enough to hold the value, returns 
 // NULL.  The msb will be in array position length - byte_length().
 //
-unsigned char* BigInt::byte_array_value(long length) const
+template <typename Digit, typename TwoDigits>
+unsigned char* BasicBigInt<Digit, TwoDigits>::byte_array_value(long length) const
 {
 	if (length < byte_length()) return NULL;
 	unsigned char* result = new unsigned char[length];
@@ -1928,7 +5779,8 @@ unsigned char* BigInt::byte_array_value(long length) const
 // byte_length()).  If the value is negative, the array contains the two's 
 // complement.
 //
-void BigInt::byte_array_value(unsigned char* result, long length) const
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::byte_array_value(unsigned char* result, long length) const
 {
 	memset(result, 0, length);
 	DIGIT digit = 0;
@@ -1950,90 +5802,346 @@ void BigInt::byte_array_value(unsigned char* result, long length) const
 		complement_bytes(result, length);
 }
 
-long BigInt::long_value() const
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::long_value() const
 {
-#if DIGITBITS == 32
-	return negative ? -(long)value[lsd] : value[lsd];
-#else
-	long result = 0;
-	
+	unsigned long result = ul_value();
+	return (long)(negative ? 0UL - result : result);
+}
+
+template <typename Digit, typename TwoDigits>
+unsigned long BasicBigInt<Digit, TwoDigits>::ul_value() const
+{
+	unsigned long result = 0;
+
+	// Shifting by the full width of a 32-bit long is undefined, so do it
+	// in two halves
 	for (long i=msd; i<=lsd; i++)
 	{
-		result <<= DIGITBITS;
+		result <<= DIGITBITS/2;
+		result <<= DIGITBITS/2;
 		result += value[i];
 	}
 
-	return negative ? -result : result;
-#endif
+	return result;
 }
 
-unsigned long BigInt::ul_value() const
+// String output
+
+// Where string output goes: straight into a buffer big enough for all of
+// it, or through a smaller one that's handed to flush() whenever it fills.
+// Once a flush fails, nothing more is written.
+//
+struct RadixOutput
 {
-#if DIGITBITS == 32
-	return value[lsd];
-#else	
-	unsigned long result = 0;
+	char* buf;
+	long size;					// 0 if buf holds everything
+	long used;
+	bool (*flush)(void* context, const char* s, long len);
+	void* context;
+	bool failed;
+};
+
+static void radix_flush(RadixOutput* out)
+{
+	if (out->used && !out->failed)
+		out->failed = !out->flush(out->context, out->buf, out->used);
+	out->used = 0;
+}
 
-	for (long i=msd; i<=lsd; i++)
+// Append len characters from s, or len copies of c if s is NULL.
+//
+static void radix_put(RadixOutput* out, const char* s, char c, long len)
+{
+	while (len > 0 && !out->failed)
 	{
-		result <<= DIGITBITS;
-		result += value[i];
+		long room = out->size ? out->size - out->used : len;
+		if (!room)
+		{
+			radix_flush(out);
+			continue;
+		}
+		long count = (len < room) ? len : room;
+		if (s)
+		{
+			memcpy(&out->buf[out->used], s, count);
+			s += count;
+		}
+		else
+			memset(&out->buf[out->used], c, count);
+		out->used += count;
+		len -= count;
+	}
+}
+
+// Write the n-limb a in the base to out.  a is destroyed.  a must be less
+// than the square of powers[k].  If pad is set, leading zeros are written
+// to make the full d*2^(k+1) digits.
+//
+static void limbs_to_radix(RadixOutput* out, LIMB* a, long n, const Radix* radix, int k, bool pad)
+{
+	static const char digit_chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	int d = radix->digits;
+	while (n && !a[n-1])
+		--n;
+	if (out->failed)
+		return;
+
+	if (k < 0 || n < RADIXLIMBS)
+	{
+		// Peel off a limb's worth of digits at a time from the bottom,
+		// filling the digits in from the end
+		//
+		char digits[RADIXLIMBS*LIMBBITS];
+		long pos = sizeof(digits);
+		while (n)
+		{
+			LIMB chunk = bigint_divrem_1(a, a, n, radix->chunk);
+			if (!a[n-1])
+				--n;
+			for (int i=0; i<d && (chunk || n); i++)
+			{
+				digits[--pos] = digit_chars[chunk % radix->base];
+				chunk /= radix->base;
+			}
+		}
+
+		long count = sizeof(digits) - pos;
+		if (pad)
+			radix_put(out, NULL, '0', ((long)d << (k+1)) - count);
+		radix_put(out, &digits[pos], 0, count);
+		return;
+	}
+
+	// Split at powers[k].  When there is no top half, the bottom half
+	// gets the leading zeros, if any.
+	//
+	long pn = radix->plen[k];
+	if (n < pn)
+	{
+		if (pad)
+			radix_put(out, NULL, '0', (long)d << k);
+		limbs_to_radix(out, a, n, radix, k-1, pad);
+		return;
+	}
+
+	long qn = n-pn+1;
+	LIMB* q = new LIMB[qn+pn];
+	LIMB* r = &q[qn];
+	bigint_divrem(q, r, a, n, radix->powers[k], pn);
+
+	bool top = false;
+	for (long i=0; i<qn && !top; i++)
+		top = (q[i] != 0);
+	if (top || pad)
+		limbs_to_radix(out, q, qn, radix, k-1, pad);
+	limbs_to_radix(out, r, pn, radix, k-1, top || pad);
+	delete[] q;
+}
+
+// Write the non-zero n-limb a in a power-of-two base at out, returning the
+// number of digits.
+//
+static long bits_to_radix(char* out, const LIMB* a, long n, int bits)
+{
+	static const char digit_chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	while (!a[n-1])
+		--n;
+	long total = n*LIMBBITS;
+	for (LIMB top=a[n-1]; !(top >> (LIMBBITS-1)); top<<=1)
+		--total;
+
+	long count = (total + bits-1) / bits;
+	LIMB mask = ((LIMB)1 << bits) - 1;
+	for (long i=0; i<count; i++)
+	{
+		long pos = (count-1-i)*bits;
+		LIMB v = a[pos/LIMBBITS] >> (pos%LIMBBITS);
+		if (pos%LIMBBITS + bits > LIMBBITS && pos/LIMBBITS+1 < n)
+			v |= a[pos/LIMBBITS+1] << (LIMBBITS - pos%LIMBBITS);
+		out[i] = digit_chars[v & mask];
+	}
+	return count;
+}
+
+// Limbs of scratch space to_string() keeps on the stack, so that small
+// values are written without touching the heap.
+#define STRINGSTACKLIMBS 16
+
+template <typename Digit, typename TwoDigits>
+char* BasicBigInt<Digit, TwoDigits>::decimal_string_value() const
+{
+	return to_string(10);
+}
+
+// Writes the value in decimal into result, which must have room for
+// to_string_size(10) characters, and returns its length.
+//
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::decimal_string_value(char* result) const
+{
+	return to_string(result, 10);
+}
+
+// The value in decimal, converted the first time it's asked for and kept
+// until the value next changes, with its length (not counting the
+// terminator) stored in *length if that isn't NULL.  The string belongs
+// to this BigInt.  Filling the cache writes to the object, so the first
+// call mustn't race with another on the same value.
+//
+template <typename Digit, typename TwoDigits>
+const char* BasicBigInt<Digit, TwoDigits>::cached_decimal(long* length) const
+{
+	if (!decimal)
+	{
+		decimal = new char[to_string_size(10)];
+		decimal_length = to_string(decimal, 10);
+	}
+	if (length)
+		*length = decimal_length;
+	return decimal;
+}
+
+// Returns enough room for the value in the given base, from 2 to 36,
+// counting the minus sign and the terminator, or 0 for any other base.
+// It's exact for powers of two, and at most a character per limb over
+// otherwise.
+//
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::to_string_size(int base) const
+{
+	if (base < 2 || base > 36)
+		return 0;
+	if (zero())
+		return 2;
+
+	Radix radix;
+	radix_init(&radix, base);
+	if (radix.bits)
+	{
+		long bits = (lsd-msd)*DIGITBITS;
+		for (DIGIT top=value[msd]; top; top>>=1)
+			++bits;
+		return (bits + radix.bits-1) / radix.bits + negative + 1;
 	}
+	return limb_count()*(radix.digits+1) + negative + 1;
+}
 
+// The value in the given base, from 2 to 36, with lower case letters for
+// digits from 10 up, or NULL for any other base.  The caller delete[]s
+// it.
+//
+template <typename Digit, typename TwoDigits>
+char* BasicBigInt<Digit, TwoDigits>::to_string(int base) const
+{
+	long size = to_string_size(base);
+	if (!size)
+		return NULL;
+	char* result = new char[size];
+	to_string(result, base);
 	return result;
-#endif
 }
 
-char* BigInt::decimal_string_value() const
+// Writes the value in the given base into result, which must have room
+// for to_string_size(base) characters, and returns its length not
+// counting the terminator, or -1 if the base isn't from 2 to 36.
+//
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::to_string(char* result, int base) const
 {
-	// If this is zero, just do something simple.  Note we shouldn't 
-	// just return "0", since we expect the caller to delete[].
-	//
+	if (base < 2 || base > 36)
+		return -1;
+
 	if (zero())
 	{
-		char* result = new char[2];
 		result[0] = '0';
 		result[1] = 0;
-		return result;
-	}
-	
-	// TODO: this is horribly inefficient!
-	// Allocate more than enough characters, plus one for a minus sign if needed
-	//
-	char* result = new char[(lsd+1-msd)*(DIGITBITS/2)+1];
-	long sofar = 0;
-	//
-	BigInt tmp = *this;
-	tmp.negative = false;	// only interested in magnitude
-	while (!tmp.zero())
-	{
-		// Shift the ones we have so far to the right
-		//
-		for (long i=sofar; i>0; i--)
-			result[i] = result[i-1];
-		
-		//
-		result[0] = (char)((tmp%(unsigned long)10).ul_value()) + '0';
-		tmp /= (unsigned long)10;
-		++sofar;
+		return 1;
 	}
-	result[sofar] = 0;
-	
+
+	long n = limb_count();
+	LIMB stack[STRINGSTACKLIMBS];
+	LIMB* a = (n <= STRINGSTACKLIMBS) ? stack : new LIMB[n];
+	to_limbs(a, n);
+
+	Radix radix;
+	radix_init(&radix, base);
+	long pos = 0;
 	if (negative)
+		result[pos++] = '-';
+	if (radix.bits)
+		pos += bits_to_radix(&result[pos], a, n, radix.bits);
+	else
 	{
-		// Shift the ones we have so far to the right
-		//
-		for (long i=sofar+1; i>0; i--)
-			result[i] = result[i-1];
-		
-		// Stick in the minus sign
+		// A limb holds fewer than d+1 digits, so the value is less than
+		// the square of the last power made
 		//
-		result[0] = '-';
+		int k = -1;
+		if (n >= RADIXLIMBS)
+			k = radix_powers(&radix, n*(radix.digits+1));
+		RadixOutput out = { &result[pos], 0, 0, NULL, NULL, false };
+		limbs_to_radix(&out, a, n, &radix, k, false);
+		pos += out.used;
+		radix_free(&radix);
 	}
-	return result;
+	result[pos] = 0;
+
+	if (a != stack)
+		delete[] a;
+	return pos;
+}
+
+// Characters of buffer the streaming output uses.
+#define STREAMCHUNK 65536
+
+// Writes the value in decimal through flush(context, s, len), in pieces
+// of at most 64K characters, so that huge values never need the whole
+// string in memory.  Stops and returns false as soon as flush() does.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::write_decimal(bool (*flush)(void*, const char*, long), void* context) const
+{
+	char* buf = new char[STREAMCHUNK];
+	RadixOutput out = { buf, STREAMCHUNK, 0, flush, context, false };
+	if (negative)
+		radix_put(&out, "-", 0, 1);
+
+	long n = limb_count();
+	LIMB* a = new LIMB[n];
+	to_limbs(a, n);
+	Radix radix;
+	radix_init(&radix, 10);
+	int k = -1;
+	if (n >= RADIXLIMBS)
+		k = radix_powers(&radix, n*(radix.digits+1));
+	if (zero())
+		radix_put(&out, "0", 0, 1);
+	else
+		limbs_to_radix(&out, a, n, &radix, k, false);
+	radix_flush(&out);
+
+	radix_free(&radix);
+	delete[] a;
+	delete[] buf;
+	return !out.failed;
 }
 
-long BigInt::MPint_length() const
+static bool flush_file(void* context, const char* s, long len)
+{
+	return fwrite(s, 1, len, (FILE*)context) == (size_t)len;
+}
+
+// Writes the value in decimal to the file, a piece at a time.  Returns
+// false if a write fails.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::write_decimal(FILE* file) const
+{
+	return write_decimal(flush_file, file);
+}
+
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::MPint_length() const
 {
 	// A zero value is represented with four zero bytes in the length ul,
 	// and no value bytes after that.
@@ -2068,14 +6176,16 @@ long BigInt::MPint_length() const
 	return result;
 }
 
-unsigned char* BigInt::MPint_value() const
+template <typename Digit, typename TwoDigits>
+unsigned char* BasicBigInt<Digit, TwoDigits>::MPint_value() const
 {
 	unsigned char* result = new unsigned char[MPint_length()];
 	MPint_value(result);
 	return result;
 }
 
-void BigInt::MPint_value(unsigned char* result) const
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::MPint_value(unsigned char* result) const
 {
 	long length = MPint_length()-4;
 
@@ -2094,25 +6204,185 @@ void BigInt::MPint_value(unsigned char* result) const
 }
 
 // Return the number of (significant) bits in our integer.
-unsigned long BigInt::num_bits() const
+template <typename Digit, typename TwoDigits>
+unsigned long BasicBigInt<Digit, TwoDigits>::num_bits() const
+{
+	for (long i=msd; i<=lsd; i++)
+		if (value[i] != 0)
+			return (unsigned long)(lsd-i)*DIGITBITS + bit_length(value[i]);
+
+	return 0;
+}
+
+// Binary files
+
+// A 24-byte header, then the magnitude in 64-bit limbs, least significant
+// first.  Everything is little-endian:
+//
+//	0	"BIGINT"	magic
+//	6	1			format version
+//	7	flags		bit 0 set for a negative value
+//	8	8			bytes per limb (32 bits)
+//	12	0			reserved (32 bits)
+//	16	count		number of limbs (64 bits)
+//
+#define FILEMAGIC "BIGINT"
+#define FILEVERSION 1
+#define FILEHEADERBYTES 24
+
+static void put_le(unsigned char* p, uint64_t value, int bytes)
+{
+	for (int i=0; i<bytes; i++, value>>=8)
+		p[i] = (unsigned char)(value & 0xFF);
+}
+
+static uint64_t get_le(const unsigned char* p, int bytes)
+{
+	uint64_t value = 0;
+	for (int i=bytes-1; i>=0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+// Writes the value to the file at path, replacing it.  Returns false if
+// it can't be written.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::save(const char* path) const
 {
-	for (int i=msd; i>=lsd; i--) {
-		if (value[i] != 0) {
-			for (int bitnum = 7; bitnum >= 0; bitnum--) {
-				if (value[i] & (1 << bitnum))
-					return ((i - lsd) * 8 + bitnum);
+	FILE* file = fopen(path, "wb");
+	if (!file)  return false;
+
+	long n = limb_count();
+	unsigned char buf[4096];
+	memcpy(buf, FILEMAGIC, 6);
+	buf[6] = FILEVERSION;
+	buf[7] = negative ? 1 : 0;
+	put_le(&buf[8], LIMBBYTES, 4);
+	put_le(&buf[12], 0, 4);
+	put_le(&buf[16], n, 8);
+	long used = FILEHEADERBYTES;
+
+	// The digits from the bottom up, a byte at a time, padded out to
+	// whole limbs
+	//
+	bool ok = true;
+	long bytes = 0;
+	for (long i=lsd; ok && bytes<n*LIMBBYTES; i--)
+	{
+		DIGIT digit = (i >= msd) ? value[i] : 0;
+		for (int b=0; b<DIGITBYTES; b++, bytes++)
+		{
+			buf[used++] = (unsigned char)((digit >> (8*b)) & 0xFF);
+			if (used == (long)sizeof(buf))
+			{
+				ok = (fwrite(buf, 1, used, file) == (size_t)used);
+				used = 0;
 			}
 		}
 	}
+	ok = ok && fwrite(buf, 1, used, file) == (size_t)used;
+	return (fclose(file) == 0) && ok;
+}
 
-	return 0;
+// Sets the value from the file at path, written by save().  The file is
+// mapped read-only where the system allows, and the digits are filled in
+// straight from the mapping.  Returns false, leaving zero, if the file
+// can't be read or isn't in the format.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::load_mmap(const char* path)
+{
+	uncache();
+	set_zero();
+
+	const unsigned char* data;
+	long size;
+#if HAVE_MMAP
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)  return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < FILEHEADERBYTES)
+	{
+		close(fd);
+		return false;
+	}
+	size = st.st_size;
+	void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)  return false;
+	data = (const unsigned char*)map;
+#else
+	FILE* file = fopen(path, "rb");
+	if (!file)  return false;
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	unsigned char* contents = (size >= FILEHEADERBYTES) ? new unsigned char[size] : NULL;
+	bool read = contents && fread(contents, 1, size, file) == (size_t)size;
+	fclose(file);
+	if (!read)
+	{
+		delete[] contents;
+		return false;
+	}
+	data = contents;
+#endif
+
+	// Check the header, and that the limbs fill the rest exactly
+	//
+	uint64_t count = get_le(&data[16], 8);
+	bool ok = !memcmp(data, FILEMAGIC, 6) && data[6] == FILEVERSION &&
+		get_le(&data[8], 4) == LIMBBYTES &&
+		count == (uint64_t)(size - FILEHEADERBYTES) / LIMBBYTES &&
+		(size - FILEHEADERBYTES) % LIMBBYTES == 0;
+	if (ok && count)
+	{
+		long digits = count * (LIMBBYTES/DIGITBYTES);
+		DIGIT* result = new DIGIT[digits];
+		const unsigned char* p = &data[FILEHEADERBYTES];
+		for (long i=digits-1; i>=0; i--, p+=DIGITBYTES)
+			result[i] = (DIGIT)get_le(p, DIGITBYTES);
+		ok = use_value(result, digits, (data[7] & 1) != 0);
+		if (zero())
+			negative = false;
+	}
+
+#if HAVE_MMAP
+	munmap(map, size);
+#else
+	delete[] contents;
+#endif
+	return ok;
+}
+
+
+
+// Kernel selection
+
+// Returns the name of the arithmetic kernels in use.
+//
+template <typename Digit, typename TwoDigits>
+const char* BasicBigInt<Digit, TwoDigits>::kernels()
+{
+	return bigint_kernels()->name;
+}
+
+// Switch to the named arithmetic kernels.  Returns false if they're not
+// compiled in or not supported by this CPU.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::use_kernels(const char* name)
+{
+	return bigint_select_kernels(name);
 }
 
 // Utilities
 
 // Modify array so it contains the twos-complement of the bytes it holds.
 //
-void BigInt::complement_bytes(unsigned char* array, long count) const
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::complement_bytes(unsigned char* array, long count) const
 {
 	long i;
 	for (i=0; i<count; i++)
@@ -2122,9 +6392,97 @@ void BigInt::complement_bytes(unsigned char* array, long count) const
 	array[i] += 1;
 }
 
+// Drops the cached decimal string.  Everything that changes the value
+// calls this first.
+//
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::uncache()
+{
+	if (decimal)
+	{
+		delete[] decimal;
+		decimal = NULL;
+	}
+}
+
+// Makes this BigInt another user of bi's digits, however long they are,
+// without copying them.  The digits must not be written in place while
+// anyone else shares them: see unshare().
+//
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::share(const BasicBigInt& bi)
+{
+	long* count = REFS_LOAD(&bi.refs);
+	if (!count)
+	{
+		// The first copy starts the count, which includes bi itself;
+		// if another thread got there first, use its count instead
+		count = new long(1);
+#if defined(__GNUC__) || defined(__clang__)
+		long* none = NULL;
+		if (!__atomic_compare_exchange_n(&bi.refs, &none, count, false,
+										 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			delete count;
+			count = none;
+		}
+#else
+		bi.refs = count;
+#endif
+	}
+	REFS_ADD(count, 1);
+	value = bi.value;
+	refs = count;
+	msd = bi.msd;
+	lsd = bi.lsd;
+	negative = bi.negative;
+}
+
+// Lets go of the digits, freeing them unless another BigInt still shares
+// them.
+//
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::release()
+{
+	if (refs)
+	{
+		if (!REFS_ADD(refs, -1))
+		{
+			delete refs;
+			delete[] value;
+		}
+		refs = NULL;
+	}
+	else if (value)
+		delete[] value;
+	value = NULL;
+}
+
+// Everything that writes the digits in place calls this first, to take a
+// copy of its own if they're shared.
+//
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::unshare()
+{
+	if (!refs)
+		return;
+	if (REFS_LOAD(refs) == 1)
+	{
+		// Everyone else has gone, so they're ours again
+		delete refs;
+		refs = NULL;
+		return;
+	}
+	DIGIT* copy = new DIGIT[lsd+1];
+	memcpy(copy, value, (lsd+1)*DIGITBYTES);
+	release();
+	value = copy;
+}
+
 // Extend value[] by the given number of digits.
 //
-bool BigInt::extend(long digits)
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::extend(long digits)
 {
 	if (digits <= 0)
 		return true;
@@ -2135,7 +6493,7 @@ bool BigInt::extend(long digits)
     memcpy(&newvalue[digits], value, (lsd+1)*DIGITBYTES);
     memset(newvalue, 0, digits*DIGITBYTES);
 
-    delete[] value;
+    release();
     value = newvalue;
     lsd += digits;
 	msd += digits;
@@ -2143,6 +6501,70 @@ bool BigInt::extend(long digits)
 	return true;
 }
 
+// Returns the magnitude mod word, leaving the value alone.
+//
+template <typename Digit, typename TwoDigits>
+uint32_t BasicBigInt<Digit, TwoDigits>::mod_word(uint32_t word) const
+{
+	uint64_t rem = 0;
+	for (long i=msd; i<=lsd; i++)
+		rem = ((rem << DIGITBITS) | value[i]) % word;
+	return (uint32_t)rem;
+}
+
+// Returns the number of 64-bit limbs needed to hold the magnitude.
+//
+template <typename Digit, typename TwoDigits>
+long BasicBigInt<Digit, TwoDigits>::limb_count() const
+{
+	return (lsd-msd+1 + LIMBBITS/DIGITBITS-1) / (LIMBBITS/DIGITBITS);
+}
+
+// Pack the magnitude into 'count' limbs, least significant limb first.
+//
+template <typename Digit, typename TwoDigits>
+void BasicBigInt<Digit, TwoDigits>::to_limbs(uint64_t* limbs, long count) const
+{
+	memset(limbs, 0, count*LIMBBYTES);
+	long i = lsd;
+	for (long k=0; k<count && i>=msd; k++)
+		for (int shift=0; shift<LIMBBITS && i>=msd; shift+=DIGITBITS)
+			limbs[k] |= (LIMB)value[i--] << shift;
+}
+
+// Set the value from 'count' limbs, least significant limb first.
+//
+template <typename Digit, typename TwoDigits>
+bool BasicBigInt<Digit, TwoDigits>::from_limbs(const uint64_t* limbs, long count, bool negative)
+{
+	uncache();
+	while (count > 1 && !limbs[count-1])
+		--count;
+
+	long digits = count * (LIMBBITS/DIGITBITS);
+	DIGIT* result = new DIGIT[digits];
+	if (!result)  return false;
+
+	long i = digits-1;
+	for (long k=0; k<count; k++)
+	{
+		LIMB limb = limbs[k];
+		for (int shift=0; shift<LIMBBITS; shift+=DIGITBITS)
+		{
+			result[i--] = (DIGIT)(limb & DIGITMASK);
+			limb >>= DIGITBITS;
+		}
+	}
+
+	return use_value(result, digits, negative);
+}
+
+// The widths compiled into the library; see BigInt.h.
+//
+template class BasicBigInt<uint8_t, uint16_t>;
+template class BasicBigInt<uint16_t, uint32_t>;
+template class BasicBigInt<uint32_t, uint64_t>;
+
 /*
  * Local variables:
  *  tab-width: 4
@@ -1,139 +1,195 @@
 #ifndef __BIGINT_H
 #define __BIGINT_H
 #include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+
+// BigInt's arithmetic is written once, as the BasicBigInt template, over
+// the unsigned type of one digit and the type of two.  Instantiations for
+// 8-, 16- and 32-bit digits are compiled into the library, so several
+// widths can be used side by side.  BigInt names the one the library and
+// the Lua bindings use: BIGINT_PRIMITIVE_SIZE picks it by the size of
+// TWODIGITS (64, 32 or 16 bits), as it always has.  Left alone, it's the
+// widest whose two digits fit in an unsigned long.
 
 #ifndef BIGINT_PRIMITIVE_SIZE
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define BIGINT_PRIMITIVE_SIZE 64
+#else
 #define BIGINT_PRIMITIVE_SIZE 32
 #endif
-
-#if BIGINT_PRIMITIVE_SIZE == 64
-
-// Values stored in 64-bit primitives
-#define TWODIGITS uint64_t
-#define SIGNEDTWODIGITS int64_t
-#define DIGIT uint32_t
-#define SIGNEDDIGIT int32_t
-#define TWODIGITS_IS_UL 0
-#define TWODIGITS_CONSTYPE uint64_t
-#define DIGITBYTES 4
-#define DIGITBITS 32
-#define DIGITMASK 0xFFFFFFFF
-#define DIGITHIGHBIT 0x80000000
-
-#elif BIGINT_PRIMITIVE_SIZE == 32
-
-// Values stored in 32-bit primitives
-#define DIGIT uint16_t
-#define SIGNEDDIGIT int16_t
-#define TWODIGITS uint32_t
-#define TWODIGITS_IS_UL 1
-#define TWODIGITS_CONSTYPE unsigned long
-#define SIGNEDTWODIGITS int32_t
-#define DIGITBYTES 2
-#define DIGITBITS 16
-#define DIGITMASK 0xFFFF
-#define DIGITHIGHBIT 0x8000
-#else
-
-// Values stored in 16-bit primitives
-#define DIGIT uint8_t
-#define SIGNEDDIGIT int8_t
-#define TWODIGITS uint16_t
-#define TWODIGITS_IS_UL 0
-#define TWODIGITS_CONSTYPE unsigned long
-#define SIGNEDTWODIGITS int16_t
-#define DIGITBYTES 1
-#define DIGITBITS 8
-#define DIGITMASK 0xFF
-#define DIGITHIGHBIT 0x80
-
 #endif
 
+// The signed types the same size as each digit type
+template <typename T> struct BigIntSigned;
+template <> struct BigIntSigned<uint8_t> { typedef int8_t type; };
+template <> struct BigIntSigned<uint16_t> { typedef int16_t type; };
+template <> struct BigIntSigned<uint32_t> { typedef int32_t type; };
+template <> struct BigIntSigned<uint64_t> { typedef int64_t type; };
 
 #define PARTIALS 64
 #define WINDOWSIZE 6
 
-class BigInt
+template <int Bits> class FixedBigInt;
+struct BigIntKernels;
+
+template <typename Digit, typename TwoDigits>
+class BasicBigInt
 {
+	// FixedBigInt converts through the limb helpers below
+	template <int Bits> friend class FixedBigInt;
+
+public:		// digit types, under the names the code has always used
+	typedef Digit DIGIT;
+	typedef TwoDigits TWODIGITS;
+	typedef typename BigIntSigned<Digit>::type SIGNEDDIGIT;
+	typedef typename BigIntSigned<TwoDigits>::type SIGNEDTWODIGITS;
+	enum { DIGITBYTES = sizeof(Digit), DIGITBITS = 8*sizeof(Digit) };
+	static const Digit DIGITMASK = (Digit)~(Digit)0;
+	static const Digit DIGITHIGHBIT = (Digit)((Digit)1 << (8*sizeof(Digit)-1));
+
 public:		// constructors & destructors
-	BigInt();
-	BigInt(const BigInt&);
-	BigInt(unsigned char*, long);	// defaults to positive
-	BigInt(unsigned char*, long, bool);
-	BigInt(long);
-	BigInt(TWODIGITS_CONSTYPE);
-	BigInt(const char*);
-	BigInt(const unsigned char*);
-	BigInt(long, DIGIT);
-	~BigInt();
+	BasicBigInt();
+	BasicBigInt(const BasicBigInt&);
+	BasicBigInt(unsigned char*, long);	// defaults to positive
+	BasicBigInt(unsigned char*, long, bool);
+	BasicBigInt(long);
+	BasicBigInt(unsigned long);
+	BasicBigInt(const char*);
+	BasicBigInt(const unsigned char*);
+	BasicBigInt(long, DIGIT);
+	~BasicBigInt();
 
 public:		// methods
 	// Assignment
-	bool operator=(const BigInt&);
+	bool operator=(const BasicBigInt&);
 	bool operator=(const long);
-	bool operator=(char*);
+	bool operator=(const char*);
+	bool from_string(const char*, int);
 	bool copy_bytes(const unsigned char*, long);	// defaults to positive
 	bool copy_bytes(const unsigned char*, long, bool);
+	bool copy_signed_bytes(const unsigned char*, long);
 	bool use_value(DIGIT*, long);	// defaults to positive
 	bool use_value(DIGIT*, long, bool);
 	void set_high_bit();
 
 	// Addition
-	const BigInt& operator++();	// prefix
-	const BigInt operator++(int);	// postfix
-	BigInt operator+(const BigInt&) const;
-	friend BigInt operator+(long, const BigInt&);
-	bool operator+=(const BigInt&);
+	const BasicBigInt& operator++();	// prefix
+	const BasicBigInt operator++(int);	// postfix
+	BasicBigInt operator+(const BasicBigInt&) const;
+	BasicBigInt operator+(long) const;
+	friend BasicBigInt operator+(long value, const BasicBigInt& bi)
+	{
+		BasicBigInt result = bi;
+		result += value;
+		return result;
+	}
+	bool operator+=(const BasicBigInt&);
+	bool operator+=(long);
+	bool add_word(uint32_t);
 
 	// Subtraction
-	const BigInt& operator--();	// prefix
-	const BigInt operator--(int);	// postfix
-	BigInt operator-(const BigInt&) const;
-	friend BigInt operator-(long, const BigInt&);
-	bool operator-=(const BigInt&);
+	const BasicBigInt& operator--();	// prefix
+	const BasicBigInt operator--(int);	// postfix
+	BasicBigInt operator-(const BasicBigInt&) const;
+	BasicBigInt operator-(long) const;
+	friend BasicBigInt operator-(long value, const BasicBigInt& bi)
+	{
+		BasicBigInt result = bi;
+		if (!result.zero())
+			result.negate();
+		result += value;
+		return result;
+	}
+	bool operator-=(const BasicBigInt&);
+	bool operator-=(long);
+	bool sub_word(uint32_t);
 
 	// Multiplication
-	BigInt operator*(const BigInt&) const;
-	friend BigInt operator*(long, const BigInt&);
-	bool operator*=(const BigInt&);
+	BasicBigInt operator*(const BasicBigInt&) const;
+	BasicBigInt operator*(long) const;
+	friend BasicBigInt operator*(long value, const BasicBigInt& bi)
+	{
+		BasicBigInt result = bi;
+		result *= value;
+		return result;
+	}
+	bool operator*=(const BasicBigInt&);
+	bool operator*=(long);
+	bool mul_word(uint32_t);
 	bool square();
-	bool squaremod(const BigInt&);
+	bool squaremod(const BasicBigInt&);
 	bool negate();
 
 	// Division
-	BigInt operator/(const BigInt&) const;
-	friend BigInt operator/(long, const BigInt&);
-	bool operator/=(const BigInt&);
+	BasicBigInt operator/(const BasicBigInt&) const;
+	BasicBigInt operator/(long) const;
+	friend BasicBigInt operator/(long value, const BasicBigInt& bi)
+	{
+		BasicBigInt result = value;
+		result /= bi;
+		return result;
+	}
+	bool operator/=(const BasicBigInt&);
+	bool operator/=(long);
+	uint32_t divmod_word(uint32_t);
+	bool divexact(const BasicBigInt&);
 
 	// Modulation
-	BigInt operator%(const BigInt&) const;
-	friend BigInt operator%(long, const BigInt&);
-	bool operator%=(const BigInt&);
-	bool multmod(const BigInt&, const BigInt&);
+	BasicBigInt operator%(const BasicBigInt&) const;
+	BasicBigInt operator%(long) const;
+	friend BasicBigInt operator%(long value, const BasicBigInt& bi)
+	{
+		BasicBigInt result = value;
+		result %= bi;
+		return result;
+	}
+	bool operator%=(const BasicBigInt&);
+	bool operator%=(long);
+	bool multmod(const BasicBigInt&, const BasicBigInt&);
 
 	// Exponentiation
-	BigInt exp(const BigInt&);
-	BigInt expmod(const BigInt&, const BigInt&) const;
+	BasicBigInt exp(const BasicBigInt&);
+	BasicBigInt expmod(const BasicBigInt&, const BasicBigInt&) const;
+	static bool expmod_many(const BasicBigInt*, const BasicBigInt*, const BasicBigInt*, BasicBigInt*, long);
 
 	// Multiplicative inverse
-	BigInt inv(const BigInt&) const;
+	BasicBigInt inv(const BasicBigInt&) const;
 
 	// Multiplicative inverse
-	BigInt gcd(const BigInt&) const;
+	BasicBigInt gcd(const BasicBigInt&) const;
+
+	// Roots
+	BasicBigInt isqrt() const;
+	bool isqrt_rem(BasicBigInt*, BasicBigInt*) const;
+	BasicBigInt iroot(unsigned long) const;
+	bool is_square() const;
+	bool is_perfect_power(BasicBigInt*, unsigned long*) const;
+
+	// Primality
+	bool is_probable_prime(int) const;
+	BasicBigInt next_prime() const;
+	bool random_prime(unsigned long);
+	bool random_prime(unsigned long, bool (*)(void*, unsigned char*, long), void*);
+
+	// Factoring
+	long factor(BasicBigInt*) const;
+	bool ecm(BasicBigInt*, unsigned long, unsigned long, long) const;
+	bool siqs(BasicBigInt*) const;
 
 	// Comparison
-	friend bool operator==(long, const BigInt&);
-	bool operator==(const BigInt&) const;
-	friend bool operator!=(long, const BigInt&);
-	bool operator!=(const BigInt&) const;
-	friend bool operator<(long, const BigInt&);
-	bool operator<(const BigInt&) const;
-	friend bool operator<=(long, const BigInt&);
-	bool operator<=(const BigInt&) const;
-	friend bool operator>(long, const BigInt&);
-	bool operator>(const BigInt&) const;
-	friend bool operator>=(long, const BigInt&);
-	bool operator>=(const BigInt&) const;
+	friend bool operator==(long value, const BasicBigInt& bi) { return bi == value; }
+	bool operator==(const BasicBigInt&) const;
+	friend bool operator!=(long value, const BasicBigInt& bi) { return !(value == bi); }
+	bool operator!=(const BasicBigInt&) const;
+	friend bool operator<(long value, const BasicBigInt& bi) { return bi > value; }
+	bool operator<(const BasicBigInt&) const;
+	friend bool operator<=(long value, const BasicBigInt& bi) { return bi >= value; }
+	bool operator<=(const BasicBigInt&) const;
+	friend bool operator>(long value, const BasicBigInt& bi) { return bi < value; }
+	bool operator>(const BasicBigInt&) const;
+	friend bool operator>=(long value, const BasicBigInt& bi) { return bi <= value; }
+	bool operator>=(const BasicBigInt&) const;
 
 	bool is_positive() const;
 	bool is_negative() const;
@@ -147,6 +203,21 @@ public:		// methods
 	bool operator<<=(long);
 	bool operator>>=(long);
 
+	// Bitwise, as two's complement for negative values
+	BasicBigInt operator&(const BasicBigInt&) const;
+	BasicBigInt operator|(const BasicBigInt&) const;
+	BasicBigInt operator^(const BasicBigInt&) const;
+	BasicBigInt operator~() const;
+	bool operator&=(const BasicBigInt&);
+	bool operator|=(const BasicBigInt&);
+	bool operator^=(const BasicBigInt&);
+	bool complement();
+	bool testbit(unsigned long) const;
+	bool setbit(unsigned long);
+	bool clearbit(unsigned long);
+	unsigned long popcount() const;
+	unsigned long ctz() const;
+
 	// Output
 	long byte_length() const;
 	unsigned char* byte_array_value() const;
@@ -156,50 +227,118 @@ public:		// methods
 	long long_value() const;
 	unsigned long ul_value() const;
 	char* decimal_string_value() const;
-//	friend ostream& operator<<(ostream&, const BigInt&);
+	long decimal_string_value(char*) const;
+	const char* cached_decimal(long*) const;
+	long to_string_size(int) const;
+	char* to_string(int) const;
+	long to_string(char*, int) const;
+	bool write_decimal(FILE*) const;
+	bool write_decimal(bool (*)(void*, const char*, long), void*) const;
+
+	// Binary files
+	bool save(const char*) const;
+	bool load_mmap(const char*);
+//	friend ostream& operator<<(ostream&, const BasicBigInt&);
 	long MPint_length() const;
 	unsigned char* MPint_value() const;
 	void MPint_value(unsigned char*) const;
 	unsigned long num_bits() const;
 
+	// Kernel selection
+	static const char* kernels();
+	static bool use_kernels(const char*);
+
 private:	// methods
 	// Assignment
 	bool set_value(long);
 	bool set_value(unsigned long);
 	bool set_value(const char*);
+	bool set_magnitude(const char*, long, int);
 	bool set_value(const unsigned char*);
 	bool set_zero();
 	bool copy_value(DIGIT*, long);	// defaults to positive
 	bool copy_value(DIGIT*, long, bool);
 
 	// Addition
-	bool add_BigInt(const BigInt&);
+	bool add_BigInt(const BasicBigInt&);
 	bool add_digit(DIGIT);
+	bool add_word_magnitude(uint32_t);
 
 	// Subtraction
-	bool subtract_from_BigInt(const BigInt&);
-	void subtract_BigInt(const BigInt&);
+	bool subtract_from_BigInt(const BasicBigInt&);
+	void subtract_BigInt(const BasicBigInt&);
 	void subtract_digit(DIGIT);
+	void subtract_word_magnitude(uint32_t);
+
+	// Multiplication
+	bool kernel_multiply(const BasicBigInt&);
+	bool kernel_square();
+
+	// Division
+	bool kernel_divide(const BasicBigInt&, BasicBigInt*, BasicBigInt*) const;
 
 	// Exponentiation
-	BigInt& get_partial (BigInt**, long, const BigInt&) const;
+	BasicBigInt& get_partial (BasicBigInt**, long, const BasicBigInt&) const;
+	BasicBigInt montgomery_expmod(const BasicBigInt&, const BasicBigInt&) const;
+	BasicBigInt montgomery_form(const BasicBigInt&, long) const;
+	static bool expmod_lanes(const BasicBigInt*, const BasicBigInt*, const BasicBigInt*, BasicBigInt*, const long*, long,
+							 const BigIntKernels*);
 
 	// Comparison
-	int value_compare(const BigInt&) const;
+	int value_compare(const BasicBigInt&) const;
+	bool word_value(uint32_t*) const;
 
 	// Shifting
 	bool shift_left_one();
 
+	// Bitwise
+	bool bitwise(const BasicBigInt&, char);
+
+	// Roots
+	void sqrtrem(BasicBigInt*, BasicBigInt*) const;
+	void sqrtrem_newton(BasicBigInt*, BasicBigInt*) const;
+	bool power_residue(unsigned long) const;
+
+	// Primality
+	bool strong_probable_prime(const BasicBigInt&) const;
+	bool strong_lucas_probable_prime() const;
+	int jacobi(long) const;
+
+	// Factoring
+	static void factor_rest(const BasicBigInt&, BasicBigInt*, long*);
+	static BasicBigInt pollard_brent(const BasicBigInt&, uint64_t, unsigned long);
+	static void* ecm_worker(void*);
+	static void* siqs_worker(void*);
+
 	// Utilities
 	void complement_bytes(unsigned char*, long) const;
+	void uncache();
+	void share(const BasicBigInt&);
+	void release();
+	void unshare();
 	bool extend(long digits);
+	uint32_t mod_word(uint32_t) const;
+	long limb_count() const;
+	void to_limbs(uint64_t*, long) const;
+	bool from_limbs(const uint64_t*, long, bool);
 
 private:	// member variables
 	DIGIT* value;
+	mutable long* refs;	// shared with copies, or NULL if only ours
 	long msd, lsd;
 	bool negative;
+	mutable char* decimal;	// see cached_decimal()
+	mutable long decimal_length;
 };
 
+#if BIGINT_PRIMITIVE_SIZE == 64
+typedef BasicBigInt<uint32_t, uint64_t> BigInt;
+#elif BIGINT_PRIMITIVE_SIZE == 32
+typedef BasicBigInt<uint16_t, uint32_t> BigInt;
+#else
+typedef BasicBigInt<uint8_t, uint16_t> BigInt;
+#endif
+
 #endif
 
 /*
@@ -0,0 +1,1327 @@
+/*
+ * BigIntKernels - inner-loop arithmetic kernels for the BigInt class
+ *
+ * This code is provided under the MIT license.
+ *
+ * Copyright (c) 2026 Jorj Bauer
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "BigIntKernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_KERNELS 0
+#endif
+
+// Portable kernels
+
+// Multiply two limbs, returning the low limb and storing the high limb
+// in *hi.
+//
+static inline LIMB mul_limbs(LIMB a, LIMB b, LIMB* hi)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 p = (unsigned __int128)a * b;
+	*hi = (LIMB)(p >> LIMBBITS);
+	return (LIMB)p;
+#else
+	// No double-width type, so build it from four 32x32 products
+	uint64_t al = (uint32_t)a, ah = a >> 32;
+	uint64_t bl = (uint32_t)b, bh = b >> 32;
+	uint64_t ll = al*bl, lh = al*bh, hl = ah*bl, hh = ah*bh;
+	uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+	*hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+	return (mid << 32) | (uint32_t)ll;
+#endif
+}
+
+static LIMB portable_addmul_1(LIMB* r, const LIMB* a, long n, LIMB b)
+{
+	LIMB carry = 0;
+	for (long i=0; i<n; i++)
+	{
+		LIMB hi;
+		LIMB lo = mul_limbs(a[i], b, &hi);
+		lo += carry;
+		hi += (lo < carry);
+		r[i] += lo;
+		hi += (r[i] < lo);
+		carry = hi;
+	}
+	return carry;
+}
+
+// Schoolbook multiplication, one row of a per limb of b.
+//
+static inline void mul_rows(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn,
+							LIMB (*addmul_1)(LIMB*, const LIMB*, long, LIMB))
+{
+	memset(r, 0, an*LIMBBYTES);
+	for (long j=0; j<bn; j++)
+		r[an+j] = addmul_1(&r[j], a, an, b[j]);
+}
+
+// Squaring: sum the products below the diagonal once, double them, then
+// add in the squares of each limb.  This does about half the multiplies of
+// mul_rows().
+//
+static inline void sqr_rows(LIMB* r, const LIMB* a, long n,
+							LIMB (*addmul_1)(LIMB*, const LIMB*, long, LIMB))
+{
+	memset(r, 0, 2*n*LIMBBYTES);
+	for (long i=0; i<n-1; i++)
+		r[n+i] = addmul_1(&r[2*i+1], &a[i+1], n-1-i, a[i]);
+
+	LIMB carry = 0;
+	for (long i=0; i<2*n; i++)
+	{
+		LIMB t = r[i];
+		r[i] = (t << 1) | carry;
+		carry = t >> (LIMBBITS-1);
+	}
+
+	carry = 0;
+	for (long i=0; i<n; i++)
+	{
+		LIMB hi;
+		LIMB lo = mul_limbs(a[i], a[i], &hi);
+		LIMB s = r[2*i] + lo;
+		LIMB c = (s < lo);
+		s += carry;
+		c += (s < carry);
+		r[2*i] = s;
+		s = r[2*i+1] + hi;
+		carry = (s < hi);
+		s += c;
+		carry += (s < c);
+		r[2*i+1] = s;
+	}
+}
+
+// Compare two n-limb values, returning -1, 0 or 1.
+//
+static int compare_limbs(const LIMB* a, const LIMB* b, long n)
+{
+	for (long i=n-1; i>=0; i--)
+		if (a[i] != b[i])
+			return (a[i] < b[i]) ? -1 : 1;
+	return 0;
+}
+
+// r[0..n-1] = a[0..n-1] - b[0..n-1], returning the borrow.
+//
+static LIMB sub_limbs(LIMB* r, const LIMB* a, const LIMB* b, long n)
+{
+	LIMB borrow = 0;
+	for (long i=0; i<n; i++)
+	{
+		LIMB d = a[i] - b[i];
+		LIMB bout = (a[i] < b[i]);
+		r[i] = d - borrow;
+		borrow = bout | (d < borrow);
+	}
+	return borrow;
+}
+
+// Montgomery reduction: r[0..n-1] = t / 2^(64n) mod m, given t < m * 2^(64n)
+// in t[0..2n-1].  t is destroyed.
+//
+static inline void redc_rows(LIMB* r, LIMB* t, const LIMB* m, long n, LIMB minv,
+							 LIMB (*addmul_1)(LIMB*, const LIMB*, long, LIMB))
+{
+	LIMB top = 0;
+	for (long i=0; i<n; i++)
+	{
+		// Adding the right multiple of m clears limb i
+		LIMB carry = addmul_1(&t[i], m, n, t[i]*minv);
+		for (long k=i+n; carry && k<2*n; k++)
+		{
+			t[k] += carry;
+			carry = (t[k] < carry);
+		}
+		top += carry;
+	}
+
+	// What's left is less than 2m, so at most one subtraction is needed
+	if (top || compare_limbs(&t[n], m, n) >= 0)
+		sub_limbs(&t[n], &t[n], m, n);
+	memcpy(r, &t[n], n*LIMBBYTES);
+}
+
+// Montgomery multiplication from a full multiply (or square) followed by
+// a separate reduction.
+//
+#define MONTSTACKLIMBS 128
+static inline void montmul_rows(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+								long n, LIMB minv,
+								void (*mul)(LIMB*, const LIMB*, long, const LIMB*, long),
+								void (*sqr)(LIMB*, const LIMB*, long),
+								LIMB (*addmul_1)(LIMB*, const LIMB*, long, LIMB))
+{
+	LIMB stackbuf[2*MONTSTACKLIMBS];
+	LIMB* t = (n <= MONTSTACKLIMBS) ? stackbuf : new LIMB[2*n];
+
+	if (a == b)
+		sqr(t, a, n);
+	else
+		mul(t, a, n, b, n);
+	redc_rows(r, t, m, n, minv, addmul_1);
+
+	if (t != stackbuf)
+		delete[] t;
+}
+
+static void portable_mul(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn)
+{
+	mul_rows(r, a, an, b, bn, portable_addmul_1);
+}
+
+static void portable_sqr(LIMB* r, const LIMB* a, long n)
+{
+	sqr_rows(r, a, n, portable_addmul_1);
+}
+
+static void portable_montmul(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+							 long n, LIMB minv)
+{
+	montmul_rows(r, a, b, m, n, minv, portable_mul, portable_sqr, portable_addmul_1);
+}
+
+static const BigIntKernels portable_kernels =
+{
+	"portable",
+	portable_mul,
+	portable_sqr,
+	portable_addmul_1,
+	portable_montmul,
+	0, 0, NULL,
+};
+
+
+
+#if HAVE_X86_KERNELS
+
+// BMI2/ADX kernels.  mulx leaves the flags alone, and adcx/adox each carry
+// through a different flag, so adding in the high half of the previous
+// product and adding in the existing result limb become two independent
+// carry chains that the CPU can run side by side.
+
+__attribute__((target("bmi2,adx")))
+static LIMB adx_addmul_1(LIMB* r, const LIMB* a, long n, LIMB b)
+{
+	// Do the odd limbs at the bottom portably, so that the unrolled loop
+	// below only ever sees whole blocks of four.
+	//
+	long odd = n & 3;
+	LIMB carry = portable_addmul_1(r, a, odd, b);
+	unsigned long blocks = n >> 2;
+	if (!blocks)
+		return carry;
+	r += odd;
+	a += odd;
+
+	// The loop counter lives in rcx so it can be tested with jrcxz and
+	// stepped with lea, neither of which disturbs CF or OF.
+	//
+	__asm__ __volatile__ (
+		"xor	%%r8d, %%r8d\n\t"
+		"1:\n\t"
+		"mulx	(%[a]), %%r9, %%r10\n\t"
+		"adcx	%[carry], %%r9\n\t"
+		"adox	(%[r]), %%r9\n\t"
+		"mov	%%r9, (%[r])\n\t"
+		"mulx	8(%[a]), %%r9, %[carry]\n\t"
+		"adcx	%%r10, %%r9\n\t"
+		"adox	8(%[r]), %%r9\n\t"
+		"mov	%%r9, 8(%[r])\n\t"
+		"mulx	16(%[a]), %%r9, %%r10\n\t"
+		"adcx	%[carry], %%r9\n\t"
+		"adox	16(%[r]), %%r9\n\t"
+		"mov	%%r9, 16(%[r])\n\t"
+		"mulx	24(%[a]), %%r9, %[carry]\n\t"
+		"adcx	%%r10, %%r9\n\t"
+		"adox	24(%[r]), %%r9\n\t"
+		"mov	%%r9, 24(%[r])\n\t"
+		"lea	32(%[a]), %[a]\n\t"
+		"lea	32(%[r]), %[r]\n\t"
+		"lea	-1(%[blocks]), %[blocks]\n\t"
+		"jrcxz	2f\n\t"
+		"jmp	1b\n\t"
+		"2:\n\t"
+		"adcx	%%r8, %[carry]\n\t"
+		"adox	%%r8, %[carry]\n\t"
+		: [r] "+&r" (r), [a] "+&r" (a), [carry] "+&r" (carry), [blocks] "+&c" (blocks)
+		: "d" (b)
+		: "r8", "r9", "r10", "cc", "memory");
+
+	return carry;
+}
+
+__attribute__((target("bmi2,adx")))
+static void adx_mul(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn)
+{
+	mul_rows(r, a, an, b, bn, adx_addmul_1);
+}
+
+__attribute__((target("bmi2,adx")))
+static void adx_sqr(LIMB* r, const LIMB* a, long n)
+{
+	sqr_rows(r, a, n, adx_addmul_1);
+}
+
+__attribute__((target("bmi2,adx")))
+static void adx_montmul(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+						long n, LIMB minv)
+{
+	montmul_rows(r, a, b, m, n, minv, adx_mul, adx_sqr, adx_addmul_1);
+}
+
+static const BigIntKernels adx_kernels =
+{
+	"adx",
+	adx_mul,
+	adx_sqr,
+	adx_addmul_1,
+	adx_montmul,
+	0, 0, NULL,
+};
+
+
+
+
+// Vector kernels.  These split the limbs into smaller digits, so that
+// each vector lane holds one digit and the products of many digit pairs
+// can be summed in a 64-bit lane before any carries have to be dealt
+// with.  Carries are propagated once, when the digits are packed back
+// into limbs.
+
+// Neither vector kernel handles operands of more than this many digits,
+// which keeps the lane sums below 2^64.  Bigger ones go to scalar code.
+#define VECTORMAXDIGITS 512
+
+// Below this many limbs the scalar kernels are faster.
+#define IFMAMINLIMBS 32
+#define AVX2MINLIMBS 8
+
+// Split n limbs into dn digits of 'bits' bits each, least significant
+// first.
+//
+static void split_digits(uint64_t* d, long dn, const LIMB* a, long n, int bits)
+{
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	unsigned __int128 acc = 0;
+	int have = 0;
+	long i = 0;
+	for (long k=0; k<dn; k++)
+	{
+		if (have < bits && i < n)
+		{
+			acc |= (unsigned __int128)a[i++] << have;
+			have += LIMBBITS;
+		}
+		d[k] = (uint64_t)acc & mask;
+		acc >>= bits;
+		have = (have > bits) ? have-bits : 0;
+	}
+}
+
+// Pack dn digits of 'bits' bits into rn limbs.  Each digit may hold a
+// full 64-bit sum; the excess is carried into the digits above it.
+//
+static void join_digits(LIMB* r, long rn, const uint64_t* d, long dn, int bits)
+{
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	unsigned __int128 carry = 0, out = 0;
+	int have = 0;
+	long i = 0;
+	for (long k=0; i<rn; k++)
+	{
+		if (k < dn)
+			carry += d[k];
+		out |= (unsigned __int128)((uint64_t)carry & mask) << have;
+		carry >>= bits;
+		have += bits;
+		if (have >= LIMBBITS)
+		{
+			r[i++] = (LIMB)out;
+			out >>= LIMBBITS;
+			have -= LIMBBITS;
+		}
+	}
+}
+
+static inline long round_up(long n, long to)
+{
+	return (n + to-1) / to * to;
+}
+
+// Multiplication by way of a digit kernel.  mul_digits() computes the
+// unpropagated column sums of the digit product; it may read up to
+// 'lanes' digits either side of a, which are zeroed here.
+//
+static void digit_mul(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn,
+					  int bits, int lanes,
+					  void (*mul_digits)(uint64_t*, const uint64_t*, long, const uint64_t*, long))
+{
+	long adn = (an*LIMBBITS + bits-1) / bits;
+	long bdn = (bn*LIMBBITS + bits-1) / bits;
+	long cdn = round_up(adn+bdn, lanes);
+	uint64_t* work = new uint64_t[adn+2*lanes + bdn + cdn];
+	uint64_t* ad = work;
+	uint64_t* bd = &ad[adn+2*lanes];
+	uint64_t* cd = &bd[bdn];
+
+	memset(ad, 0, lanes*sizeof(uint64_t));
+	split_digits(&ad[lanes], adn, a, an, bits);
+	memset(&ad[lanes+adn], 0, lanes*sizeof(uint64_t));
+	split_digits(bd, bdn, b, bn, bits);
+
+	mul_digits(cd, &ad[lanes], adn, bd, bdn);
+	join_digits(r, an+bn, cd, adn+bdn, bits);
+	delete[] work;
+}
+
+// Montgomery multiplication by way of digit kernels.  The product is
+// formed with mul_digits(), then reduced one digit at a time with
+// addmul_digits(), which adds a multiple of m into the unpropagated
+// column sums.  2^(64n) is generally not a whole number of digits, so
+// the last step clears just the bits that remain.
+//
+static void digit_montmul(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+						  long n, LIMB minv, int bits, int lanes,
+						  void (*mul_digits)(uint64_t*, const uint64_t*, long, const uint64_t*, long),
+						  void (*addmul_digits)(uint64_t*, const uint64_t*, long, uint64_t))
+{
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	long dn = (n*LIMBBITS + bits-1) / bits;
+	long pdn = round_up(dn, lanes);
+	long tdn = 2*pdn + 2*lanes;
+	uint64_t* work = new uint64_t[(pdn+2*lanes) + pdn + pdn + tdn];
+	uint64_t* ad = work;
+	uint64_t* bd = &ad[pdn+2*lanes];
+	uint64_t* md = &bd[pdn];
+	uint64_t* td = &md[pdn];
+
+	memset(work, 0, ((pdn+2*lanes) + pdn + pdn + tdn)*sizeof(uint64_t));
+	split_digits(&ad[lanes], dn, a, n, bits);
+	split_digits(bd, dn, b, n, bits);
+	split_digits(md, dn, m, n, bits);
+
+	mul_digits(td, &ad[lanes], dn, bd, dn);
+
+	long steps = n*LIMBBITS / bits;
+	int rest = (int)(n*LIMBBITS % bits);
+	uint64_t carry = 0;
+	for (long i=0; i<steps; i++)
+	{
+		uint64_t y = ((td[i] + carry) * minv) & mask;
+		addmul_digits(&td[i], md, pdn, y);
+		carry = (td[i] + carry) >> bits;
+	}
+	if (rest)
+	{
+		uint64_t y = ((td[steps] + carry) * minv) & (((uint64_t)1 << rest) - 1);
+		addmul_digits(&td[steps], md, pdn, y);
+	}
+	td[steps] += carry;
+
+	// Pack what's left, dropping the low 'rest' bits which are now zero.
+	// It's less than 2m, so at most one subtraction is needed.
+	//
+	LIMB stackbuf[MONTSTACKLIMBS+2];
+	LIMB* t = (n <= MONTSTACKLIMBS) ? stackbuf : new LIMB[n+2];
+	join_digits(t, n+2, &td[steps], tdn-steps, bits);
+	if (rest)
+		for (long i=0; i<=n; i++)
+			t[i] = (t[i] >> rest) | (t[i+1] << (LIMBBITS-rest));
+	if (t[n] || compare_limbs(t, m, n) >= 0)
+		sub_limbs(t, t, m, n);
+	memcpy(r, t, n*LIMBBYTES);
+
+	if (t != stackbuf)
+		delete[] t;
+	delete[] work;
+}
+
+// Finish off multiplications done side by side in vector lanes: t holds
+// n+1 unpropagated column sums per lane, amounting to less than 2m, so
+// propagate the carries and subtract m once if need be.
+//
+#define LANESTACKDIGITS 80
+static void finish_lanes(uint64_t* r, const uint64_t* t, const uint64_t* m,
+						 long n, int lanes, int bits)
+{
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	for (int l=0; l<lanes; l++)
+	{
+		uint64_t carry = 0;
+		for (long j=0; j<n; j++)
+		{
+			uint64_t v = t[j*lanes+l] + carry;
+			carry = (v >> bits) + ((v < carry) ? ((uint64_t)1 << (LIMBBITS-bits)) : 0);
+			r[j*lanes+l] = v & mask;
+		}
+		carry += t[n*lanes+l];
+
+		// Subtract m if there's a carry out, or if what's left is >= m
+		bool subtract = (carry != 0);
+		for (long j=n-1; j>=0 && !subtract; j--)
+		{
+			if (r[j*lanes+l] != m[j*lanes+l])
+			{
+				subtract = (r[j*lanes+l] > m[j*lanes+l]);
+				break;
+			}
+			if (j == 0)
+				subtract = true;	// equal to m
+		}
+		if (subtract)
+		{
+			uint64_t borrow = 0;
+			for (long j=0; j<n; j++)
+			{
+				uint64_t v = r[j*lanes+l] - m[j*lanes+l] - borrow;
+				borrow = v >> (LIMBBITS-1);
+				r[j*lanes+l] = v & mask;
+			}
+		}
+	}
+}
+
+// AVX-512 IFMA kernels, on 52-bit digits.  vpmadd52luq and vpmadd52huq
+// add the low and high 52 bits of eight 52x52-bit products into eight
+// 64-bit lanes.
+
+#define IFMABITS 52
+#define IFMALANES 8
+
+// Column sums of a[0..an-1] * b[0..bn-1] into c[0..an+bn-1].  Each group
+// of eight columns is accumulated in registers: for every digit of b,
+// the low halves come from one window of a and the high halves from the
+// window one digit lower, which is the next iteration's low window.  Two
+// digits of b are done per pass, into separate accumulators, so that the
+// multiply-adds don't all wait on each other.
+//
+__attribute__((target("avx512f,avx512ifma")))
+static void ifma_mul_digits(uint64_t* c, const uint64_t* a, long an, const uint64_t* b, long bn)
+{
+	for (long k=0; k<an+bn; k+=IFMALANES)
+	{
+		long jlo = (k-an > 0) ? k-an : 0;
+		long jhi = (k+IFMALANES-1 < bn-1) ? k+IFMALANES-1 : bn-1;
+		__m512i acc0 = _mm512_setzero_si512();
+		__m512i acc1 = _mm512_setzero_si512();
+		__m512i acc2 = _mm512_setzero_si512();
+		__m512i acc3 = _mm512_setzero_si512();
+		__m512i lo = _mm512_loadu_si512(&a[k-jlo]);
+		long j;
+		for (j=jlo; j+1<=jhi; j+=2)
+		{
+			__m512i y0 = _mm512_set1_epi64(b[j]);
+			__m512i y1 = _mm512_set1_epi64(b[j+1]);
+			__m512i mid = _mm512_loadu_si512(&a[k-j-1]);
+			__m512i hi = _mm512_loadu_si512(&a[k-j-2]);
+			acc0 = _mm512_madd52lo_epu64(acc0, lo, y0);
+			acc1 = _mm512_madd52hi_epu64(acc1, mid, y0);
+			acc2 = _mm512_madd52lo_epu64(acc2, mid, y1);
+			acc3 = _mm512_madd52hi_epu64(acc3, hi, y1);
+			lo = hi;
+		}
+		if (j <= jhi)
+		{
+			__m512i y = _mm512_set1_epi64(b[j]);
+			__m512i hi = _mm512_loadu_si512(&a[k-j-1]);
+			acc0 = _mm512_madd52lo_epu64(acc0, lo, y);
+			acc1 = _mm512_madd52hi_epu64(acc1, hi, y);
+		}
+		acc0 = _mm512_add_epi64(_mm512_add_epi64(acc0, acc1), _mm512_add_epi64(acc2, acc3));
+		_mm512_storeu_si512(&c[k], acc0);
+	}
+}
+
+// t[0..n] += m[0..n-1] * y, unpropagated.  n is a multiple of the lane
+// count.  The high halves belong one column up, so they're shifted across
+// by a lane before being added in.
+//
+__attribute__((target("avx512f,avx512ifma")))
+static void ifma_addmul_digits(uint64_t* t, const uint64_t* m, long n, uint64_t y)
+{
+	__m512i yv = _mm512_set1_epi64(y);
+	__m512i prev = _mm512_setzero_si512();
+	long j;
+	for (j=0; j<n; j+=IFMALANES)
+	{
+		__m512i mj = _mm512_loadu_si512(&m[j]);
+		__m512i hi = _mm512_madd52hi_epu64(_mm512_setzero_si512(), mj, yv);
+		__m512i v = _mm512_loadu_si512(&t[j]);
+		v = _mm512_madd52lo_epu64(v, mj, yv);
+		v = _mm512_add_epi64(v, _mm512_maskz_alignr_epi64(0xFF, hi, prev, IFMALANES-1));
+		_mm512_storeu_si512(&t[j], v);
+		prev = hi;
+	}
+	uint64_t top[IFMALANES];
+	_mm512_storeu_si512(top, prev);
+	t[j] += top[IFMALANES-1];
+}
+
+__attribute__((target("bmi2,adx")))
+static void ifma_mul(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn)
+{
+	if (bn < IFMAMINLIMBS || bn*LIMBBITS > VECTORMAXDIGITS*IFMABITS)
+		adx_mul(r, a, an, b, bn);
+	else
+		digit_mul(r, a, an, b, bn, IFMABITS, IFMALANES, ifma_mul_digits);
+}
+
+__attribute__((target("bmi2,adx")))
+static void ifma_sqr(LIMB* r, const LIMB* a, long n)
+{
+	if (n < IFMAMINLIMBS || n*LIMBBITS > VECTORMAXDIGITS*IFMABITS)
+		adx_sqr(r, a, n);
+	else
+		digit_mul(r, a, n, a, n, IFMABITS, IFMALANES, ifma_mul_digits);
+}
+
+__attribute__((target("bmi2,adx")))
+static void ifma_montmul(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+						 long n, LIMB minv)
+{
+	if (n < IFMAMINLIMBS || n*LIMBBITS > VECTORMAXDIGITS*IFMABITS)
+		adx_montmul(r, a, b, m, n, minv);
+	else
+		digit_montmul(r, a, b, m, n, minv, IFMABITS, IFMALANES,
+					  ifma_mul_digits, ifma_addmul_digits);
+}
+
+// Eight Montgomery multiplications at once, one per lane, word by word.
+// Row i adds a * b[i] and y * m into the column sums starting at column
+// i, where y is chosen to clear the low 52 bits of column i; what's left
+// of that column is carried into the next, and the answer ends up in
+// columns n..2n-1.
+//
+__attribute__((target("avx512f,avx512ifma")))
+static void ifma_montmul_lanes(uint64_t* r, const uint64_t* a, const uint64_t* b,
+							   const uint64_t* m, long n, const uint64_t* minv)
+{
+	uint64_t stackbuf[(2*LANESTACKDIGITS+1)*IFMALANES];
+	uint64_t* t = (n <= LANESTACKDIGITS) ? stackbuf : new uint64_t[(2*n+1)*IFMALANES];
+	memset(t, 0, (2*n+1)*IFMALANES*sizeof(uint64_t));
+
+	__m512i zero = _mm512_setzero_si512();
+	__m512i mi = _mm512_loadu_si512(minv);
+	for (long i=0; i<n; i++)
+	{
+		uint64_t* ti = &t[i*IFMALANES];
+		__m512i bi = _mm512_loadu_si512(&b[i*IFMALANES]);
+		__m512i a0 = _mm512_loadu_si512(a);
+		__m512i m0 = _mm512_loadu_si512(m);
+
+		__m512i v = _mm512_madd52lo_epu64(_mm512_loadu_si512(ti), a0, bi);
+		__m512i y = _mm512_madd52lo_epu64(zero, v, mi);
+		v = _mm512_madd52lo_epu64(v, m0, y);
+		__m512i carry = _mm512_add_epi64(_mm512_maskz_srli_epi64(0xFF, v, IFMABITS),
+										 _mm512_madd52hi_epu64(_mm512_madd52hi_epu64(zero, a0, bi), m0, y));
+		for (long j=1; j<n; j++)
+		{
+			__m512i aj = _mm512_loadu_si512(&a[j*IFMALANES]);
+			__m512i mj = _mm512_loadu_si512(&m[j*IFMALANES]);
+			v = _mm512_loadu_si512(&ti[j*IFMALANES]);
+			v = _mm512_madd52lo_epu64(v, aj, bi);
+			v = _mm512_madd52lo_epu64(v, mj, y);
+			v = _mm512_add_epi64(v, carry);
+			carry = _mm512_madd52hi_epu64(_mm512_madd52hi_epu64(zero, aj, bi), mj, y);
+			_mm512_storeu_si512(&ti[j*IFMALANES], v);
+		}
+		v = _mm512_add_epi64(_mm512_loadu_si512(&ti[n*IFMALANES]), carry);
+		_mm512_storeu_si512(&ti[n*IFMALANES], v);
+	}
+
+	finish_lanes(r, &t[n*IFMALANES], m, n, IFMALANES, IFMABITS);
+	if (t != stackbuf)
+		delete[] t;
+}
+
+static const BigIntKernels ifma_kernels =
+{
+	"avx512ifma",
+	ifma_mul,
+	ifma_sqr,
+	adx_addmul_1,
+	ifma_montmul,
+	IFMALANES, IFMABITS, ifma_montmul_lanes,
+};
+
+// AVX2 kernels, on 26-bit digits.  vpmuludq forms four full 52-bit
+// products at a time, so there are no high halves to keep track of.
+
+#define AVX2BITS 26
+#define AVX2LANES 4
+
+// Column sums of a[0..an-1] * b[0..bn-1] into c[0..an+bn-1].
+//
+__attribute__((target("avx2")))
+static void avx2_mul_digits(uint64_t* c, const uint64_t* a, long an, const uint64_t* b, long bn)
+{
+	for (long k=0; k<an+bn; k+=AVX2LANES)
+	{
+		long jlo = (k-an+1 > 0) ? k-an+1 : 0;
+		long jhi = (k+AVX2LANES-1 < bn-1) ? k+AVX2LANES-1 : bn-1;
+		__m256i acc = _mm256_setzero_si256();
+		for (long j=jlo; j<=jhi; j++)
+		{
+			__m256i x = _mm256_loadu_si256((const __m256i*)&a[k-j]);
+			acc = _mm256_add_epi64(acc, _mm256_mul_epu32(x, _mm256_set1_epi64x(b[j])));
+		}
+		_mm256_storeu_si256((__m256i*)&c[k], acc);
+	}
+}
+
+// t[0..n-1] += m[0..n-1] * y, unpropagated.  n is a multiple of the lane
+// count.
+//
+__attribute__((target("avx2")))
+static void avx2_addmul_digits(uint64_t* t, const uint64_t* m, long n, uint64_t y)
+{
+	__m256i yv = _mm256_set1_epi64x(y);
+	for (long j=0; j<n; j+=AVX2LANES)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)&t[j]);
+		__m256i mj = _mm256_loadu_si256((const __m256i*)&m[j]);
+		v = _mm256_add_epi64(v, _mm256_mul_epu32(mj, yv));
+		_mm256_storeu_si256((__m256i*)&t[j], v);
+	}
+}
+
+static void avx2_mul(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn)
+{
+	if (bn < AVX2MINLIMBS || bn*LIMBBITS > VECTORMAXDIGITS*AVX2BITS)
+		portable_mul(r, a, an, b, bn);
+	else
+		digit_mul(r, a, an, b, bn, AVX2BITS, AVX2LANES, avx2_mul_digits);
+}
+
+static void avx2_sqr(LIMB* r, const LIMB* a, long n)
+{
+	if (n < AVX2MINLIMBS || n*LIMBBITS > VECTORMAXDIGITS*AVX2BITS)
+		portable_sqr(r, a, n);
+	else
+		digit_mul(r, a, n, a, n, AVX2BITS, AVX2LANES, avx2_mul_digits);
+}
+
+static void avx2_montmul(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+						 long n, LIMB minv)
+{
+	if (n < AVX2MINLIMBS || n*LIMBBITS > VECTORMAXDIGITS*AVX2BITS)
+		portable_montmul(r, a, b, m, n, minv);
+	else
+		digit_montmul(r, a, b, m, n, minv, AVX2BITS, AVX2LANES,
+					  avx2_mul_digits, avx2_addmul_digits);
+}
+
+// Four Montgomery multiplications at once, one per lane, as for
+// ifma_montmul_lanes() but on 26-bit digits.
+//
+__attribute__((target("avx2")))
+static void avx2_montmul_lanes(uint64_t* r, const uint64_t* a, const uint64_t* b,
+							   const uint64_t* m, long n, const uint64_t* minv)
+{
+	uint64_t stackbuf[(2*LANESTACKDIGITS+1)*AVX2LANES];
+	uint64_t* t = (n <= LANESTACKDIGITS) ? stackbuf : new uint64_t[(2*n+1)*AVX2LANES];
+	memset(t, 0, (2*n+1)*AVX2LANES*sizeof(uint64_t));
+
+	__m256i mask = _mm256_set1_epi64x(((uint64_t)1 << AVX2BITS) - 1);
+	__m256i mi = _mm256_loadu_si256((const __m256i*)minv);
+	for (long i=0; i<n; i++)
+	{
+		uint64_t* ti = &t[i*AVX2LANES];
+		__m256i bi = _mm256_loadu_si256((const __m256i*)&b[i*AVX2LANES]);
+		__m256i a0 = _mm256_loadu_si256((const __m256i*)a);
+		__m256i m0 = _mm256_loadu_si256((const __m256i*)m);
+
+		__m256i v = _mm256_loadu_si256((const __m256i*)ti);
+		v = _mm256_add_epi64(v, _mm256_mul_epu32(a0, bi));
+		__m256i y = _mm256_and_si256(_mm256_mul_epu32(_mm256_and_si256(v, mask), mi), mask);
+		v = _mm256_add_epi64(v, _mm256_mul_epu32(m0, y));
+		__m256i carry = _mm256_srli_epi64(v, AVX2BITS);
+		for (long j=1; j<n; j++)
+		{
+			__m256i aj = _mm256_loadu_si256((const __m256i*)&a[j*AVX2LANES]);
+			__m256i mj = _mm256_loadu_si256((const __m256i*)&m[j*AVX2LANES]);
+			v = _mm256_loadu_si256((const __m256i*)&ti[j*AVX2LANES]);
+			v = _mm256_add_epi64(v, _mm256_mul_epu32(aj, bi));
+			v = _mm256_add_epi64(v, _mm256_mul_epu32(mj, y));
+			v = _mm256_add_epi64(v, carry);
+			carry = _mm256_setzero_si256();
+			_mm256_storeu_si256((__m256i*)&ti[j*AVX2LANES], v);
+		}
+		v = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)&ti[n*AVX2LANES]), carry);
+		_mm256_storeu_si256((__m256i*)&ti[n*AVX2LANES], v);
+	}
+
+	finish_lanes(r, &t[n*AVX2LANES], m, n, AVX2LANES, AVX2BITS);
+	if (t != stackbuf)
+		delete[] t;
+}
+
+static const BigIntKernels avx2_kernels =
+{
+	"avx2",
+	avx2_mul,
+	avx2_sqr,
+	portable_addmul_1,
+	avx2_montmul,
+	AVX2LANES, AVX2BITS, avx2_montmul_lanes,
+};
+
+#endif
+
+
+
+// Algorithms built on the kernels.  These aren't part of any one kernel
+// set: they call through bigint_kernels() for their inner loops, so they
+// speed up along with whichever set is selected.
+
+// Karatsuba multiplication pays for its extra additions from this many
+// limbs up; below it the kernels' schoolbook multiplication is faster.
+#define KARATSUBALIMBS 40
+
+// Below this many limbs of divisor or quotient, divide the schoolbook way.
+#define DIVIDELIMBS 40
+
+// r[0..n-1] = a[0..n-1] + b[0..bn-1] for bn <= n, returning the carry.
+//
+static LIMB add_limbs(LIMB* r, const LIMB* a, long n, const LIMB* b, long bn)
+{
+	LIMB carry = 0;
+	long i;
+	for (i=0; i<bn; i++)
+	{
+		LIMB s = a[i] + carry;
+		carry = (s < carry);
+		r[i] = s + b[i];
+		carry += (r[i] < s);
+	}
+	for ( ; i<n; i++)
+	{
+		r[i] = a[i] + carry;
+		carry = (r[i] < carry);
+	}
+	return carry;
+}
+
+// r[0..n-1] = a[0..n-1] - b[0..bn-1] for bn <= n, returning the borrow.
+//
+static LIMB sub_limbs(LIMB* r, const LIMB* a, long n, const LIMB* b, long bn)
+{
+	LIMB borrow = sub_limbs(r, a, b, bn);
+	for (long i=bn; i<n; i++)
+	{
+		LIMB x = a[i];
+		r[i] = x - borrow;
+		borrow = (x < borrow);
+	}
+	return borrow;
+}
+
+// r[0..n-1] = |a[0..n-1] - b[0..bn-1]| for bn <= n, returning true if b
+// was the bigger.
+//
+static bool diff_limbs(LIMB* r, const LIMB* a, long n, const LIMB* b, long bn)
+{
+	long i;
+	for (i=n-1; i>=bn && !a[i]; i--);
+	if (i < bn && compare_limbs(a, b, bn) < 0)
+	{
+		sub_limbs(r, b, bn, a, bn);
+		memset(&r[bn], 0, (n-bn)*LIMBBYTES);
+		return true;
+	}
+	sub_limbs(r, a, n, b, bn);
+	return false;
+}
+
+// r[0..2n-1] = a[0..n-1] * b[0..n-1] (or a^2, when b is NULL) by
+// Karatsuba's method.  With a = a1*B + a0 and b = b1*B + b0, the middle
+// term a1*b0 + a0*b1 is a0*b0 + a1*b1 - (a0-a1)*(b0-b1), so three half-
+// size multiplies do the work of four.
+//
+static void karatsuba(LIMB* r, const LIMB* a, const LIMB* b, long n)
+{
+	if (n < KARATSUBALIMBS)
+	{
+		if (b)
+			bigint_kernels()->mul(r, a, n, b, n);
+		else
+			bigint_kernels()->sqr(r, a, n);
+		return;
+	}
+
+	long l = n - n/2;	// limbs in the low halves
+	long h = n/2;		// and in the high halves, h <= l
+	LIMB* t = new LIMB[6*l + 1];
+	LIMB* da = t;
+	LIMB* db = &t[l];
+	LIMB* p = &t[2*l];
+	LIMB* mid = &t[4*l];
+
+	// (a0-a1)*(b0-b1) is negative if exactly one difference is; a square
+	// never is
+	//
+	bool negative = diff_limbs(da, a, l, &a[l], h);
+	negative = b ? (diff_limbs(db, b, l, &b[l], h) != negative) : false;
+	karatsuba(r, a, b, l);
+	karatsuba(&r[2*l], &a[l], b ? &b[l] : NULL, h);
+	karatsuba(p, da, b ? db : NULL, l);
+
+	// mid = a0*b0 + a1*b1 -/+ p, and goes in at r[l]
+	//
+	mid[2*l] = add_limbs(mid, r, 2*l, &r[2*l], 2*h);
+	if (negative)
+		mid[2*l] += add_limbs(mid, mid, 2*l, p, 2*l);
+	else
+		mid[2*l] -= sub_limbs(mid, mid, 2*l, p, 2*l);
+	add_limbs(&r[l], &r[l], 2*n-l, mid, 2*l+1);
+
+	delete[] t;
+}
+
+void bigint_mul(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn)
+{
+	if (an < bn)
+	{
+		const LIMB* tp = a;  a = b;  b = tp;
+		long tn = an;  an = bn;  bn = tn;
+	}
+	if (bn < KARATSUBALIMBS)
+	{
+		bigint_kernels()->mul(r, a, an, b, bn);
+		return;
+	}
+	if (an == bn)
+	{
+		karatsuba(r, a, b, an);
+		return;
+	}
+
+	// Unbalanced: multiply b by bn-limb pieces of a, and add them up
+	//
+	LIMB* t = new LIMB[2*bn];
+	memset(r, 0, (an+bn)*LIMBBYTES);
+	for (long i=0; i<an; i+=bn)
+	{
+		long pn = (an-i < bn) ? an-i : bn;
+		bigint_mul(t, &a[i], pn, b, bn);
+		add_limbs(&r[i], &r[i], an+bn-i, t, pn+bn);
+	}
+	delete[] t;
+}
+
+void bigint_sqr(LIMB* r, const LIMB* a, long n)
+{
+	karatsuba(r, a, NULL, n);
+}
+
+// Returns floor((2^128-1) / d) - 2^64 for d with its high bit set: the
+// reciprocal that lets div_2by1() divide by d with multiplies.
+//
+static LIMB reciprocal_limb(LIMB d)
+{
+#if defined(__SIZEOF_INT128__)
+	return (LIMB)(~(unsigned __int128)0 / d);
+#else
+	// (2^128-1) - 2^64*d is ~d:~0, and ~d < d, so the quotient fits in a
+	// limb; this is only done once per division, so go a bit at a time
+	//
+	LIMB rem = ~d, lo = ~(LIMB)0, q = 0;
+	for (int i=0; i<LIMBBITS; i++)
+	{
+		LIMB top = rem >> (LIMBBITS-1);
+		rem = (rem << 1) | (lo >> (LIMBBITS-1));
+		lo <<= 1;
+		q <<= 1;
+		if (top || rem >= d)
+		{
+			rem -= d;
+			q |= 1;
+		}
+	}
+	return q;
+#endif
+}
+
+// Divide the two-limb u1:u0 by d, given u1 < d, d's high bit set and v =
+// reciprocal_limb(d).  Returns the quotient and leaves the remainder in
+// *r.  See Moller and Granlund, "Improved division by invariant integers".
+//
+static inline LIMB div_2by1(LIMB u1, LIMB u0, LIMB d, LIMB v, LIMB* r)
+{
+	LIMB q1;
+	LIMB q0 = mul_limbs(v, u1, &q1);
+	q0 += u0;
+	q1 += u1 + (q0 < u0) + 1;
+	LIMB rem = u0 - q1*d;
+	if (rem > q0)
+	{
+		--q1;
+		rem += d;
+	}
+	if (rem >= d)
+	{
+		++q1;
+		rem -= d;
+	}
+	*r = rem;
+	return q1;
+}
+
+static inline int leading_zeros(LIMB x)
+{
+	int n = 0;
+	for (LIMB bit=(LIMB)1 << (LIMBBITS-1); !(x & bit); bit>>=1)
+		++n;
+	return n;
+}
+
+// r[0..n-1] = a[0..n-1] << shift, for 0 < shift < 64, returning the bits
+// shifted out of the top.  r may be a.
+//
+static LIMB lshift_limbs(LIMB* r, const LIMB* a, long n, int shift)
+{
+	LIMB out = a[n-1] >> (LIMBBITS-shift);
+	for (long i=n-1; i>0; i--)
+		r[i] = (a[i] << shift) | (a[i-1] >> (LIMBBITS-shift));
+	r[0] = a[0] << shift;
+	return out;
+}
+
+// r[0..n-1] = a[0..n-1] >> shift, for 0 < shift < 64.  r may be a.
+//
+static void rshift_limbs(LIMB* r, const LIMB* a, long n, int shift)
+{
+	for (long i=0; i<n-1; i++)
+		r[i] = (a[i] >> shift) | (a[i+1] << (LIMBBITS-shift));
+	r[n-1] = a[n-1] >> shift;
+}
+
+LIMB bigint_divrem_1(LIMB* q, const LIMB* a, long n, LIMB d)
+{
+	int shift = leading_zeros(d);
+	d <<= shift;
+	LIMB v = reciprocal_limb(d);
+
+	// Shifting the dividend to match the divisor doesn't change the
+	// quotient, and the remainder just has to be shifted back
+	//
+	LIMB r = shift ? a[n-1] >> (LIMBBITS-shift) : 0;
+	for (long i=n-1; i>=0; i--)
+	{
+		LIMB u0 = a[i] << shift;
+		if (shift && i > 0)
+			u0 |= a[i-1] >> (LIMBBITS-shift);
+		q[i] = div_2by1(r, u0, d, v, &r);
+	}
+	return r >> shift;
+}
+
+// r[0..n-1] -= a[0..n-1] * b, returning the borrow out of the top limb.
+//
+static LIMB submul_1(LIMB* r, const LIMB* a, long n, LIMB b)
+{
+	LIMB borrow = 0;
+	for (long i=0; i<n; i++)
+	{
+		LIMB hi;
+		LIMB lo = mul_limbs(a[i], b, &hi);
+		lo += borrow;
+		hi += (lo < borrow);
+		hi += (r[i] < lo);
+		r[i] -= lo;
+		borrow = hi;
+	}
+	return borrow;
+}
+
+// Knuth's algorithm D.  Divides u[0..m+n-1] by the n-limb v, whose top
+// limb has its high bit set, given u < v * 2^(64(m+1)).  The low m limbs
+// of the quotient go in q and the top one (0 or 1) is returned; the
+// remainder is left in u[0..n-1], with the rest of u zeroed.  vinv is
+// reciprocal_limb(v[n-1]).
+//
+static LIMB schoolbook_divrem(LIMB* q, LIMB* u, long m, const LIMB* v, long n, LIMB vinv)
+{
+	LIMB qhigh = 0;
+	if (compare_limbs(&u[m], v, n) >= 0)
+	{
+		sub_limbs(&u[m], &u[m], v, n);
+		qhigh = 1;
+	}
+
+	LIMB d1 = v[n-1];
+	LIMB d0 = (n > 1) ? v[n-2] : 0;
+	for (long j=m-1; j>=0; j--)
+	{
+		// Estimate the quotient limb from the top two limbs, and refine
+		// the estimate with the next; it's then at most one too big
+		//
+		LIMB u2 = u[j+n], u1 = u[j+n-1];
+		LIMB u0 = (n > 1) ? u[j+n-2] : 0;
+		LIMB qhat, rhat;
+		bool rhat_overflow = false;
+		if (u2 >= d1)
+		{
+			qhat = ~(LIMB)0;
+			rhat = u1 + d1;
+			rhat_overflow = (rhat < d1);
+		}
+		else
+			qhat = div_2by1(u2, u1, d1, vinv, &rhat);
+		while (!rhat_overflow)
+		{
+			LIMB phi, plo = mul_limbs(qhat, d0, &phi);
+			if (phi < rhat || (phi == rhat && plo <= u0))
+				break;
+			--qhat;
+			rhat += d1;
+			rhat_overflow = (rhat < d1);
+		}
+
+		// Subtract qhat*v, adding v back if that went negative
+		//
+		LIMB borrow = submul_1(&u[j], v, n, qhat);
+		if (borrow > u2)
+		{
+			--qhat;
+			add_limbs(&u[j], &u[j], n, v, n);
+		}
+		u[j+n] = 0;
+		q[j] = qhat;
+	}
+	return qhigh;
+}
+
+// Divides u[0..m+n-1] by the normalized n-limb v, as schoolbook_divrem()
+// does, for m <= n.  Big divisions are split in two (the recursive
+// division of Burnikel and Ziegler, as given in Brent and Zimmermann's
+// "Modern Computer Arithmetic"): the top half of the quotient comes from
+// dividing the top of u by the top of v, and is then corrected for the
+// rest of v; the same again gives the bottom half.  All the work is
+// in multiplications, which Karatsuba makes subquadratic.
+//
+static LIMB recursive_divrem(LIMB* q, LIMB* u, long m, const LIMB* v, long n, LIMB vinv)
+{
+	if (m < DIVIDELIMBS || n < DIVIDELIMBS)
+		return schoolbook_divrem(q, u, m, v, n, vinv);
+
+	long k = m/2;
+	LIMB* t = new LIMB[m];
+	LIMB qhigh = 0;
+	for (int half=1; half>=0; half--)
+	{
+		// The top half works on u[k..] to find q[k..m-1], and the bottom
+		// half on u[0..] to find q[0..k-1].  Either can come out with an
+		// extra top bit, which is carried into the limbs above.
+		//
+		long qoff = half ? k : 0;
+		long qn = half ? m-k : k;
+		LIMB* uh = &u[qoff];
+
+		LIMB qtop = recursive_divrem(&q[qoff], &uh[k], qn, &v[k], n-k, vinv);
+		if (half)
+			qhigh = qtop;
+		else
+			qhigh += add_limbs(&q[k], &q[k], m-k, &qtop, 1);
+
+		// Take off the quotient times the low k limbs of v, then put v
+		// back while that leaves us negative
+		//
+		bigint_mul(t, &q[qoff], qn, v, k);
+		long borrow = sub_limbs(uh, uh, n, t, qn+k);
+		if (qtop)
+			borrow += sub_limbs(&uh[qn], &uh[qn], n-qn, v, k);
+		while (borrow)
+		{
+			long i;
+			for (i=qoff; i<m && q[i]--==0; i++);
+			if (i == m)
+				--qhigh;
+			borrow -= add_limbs(uh, uh, n, v, n);
+		}
+	}
+	delete[] t;
+	return qhigh;
+}
+
+void bigint_divrem(LIMB* q, LIMB* r, const LIMB* a, long an, const LIMB* d, long dn)
+{
+	if (dn == 1)
+	{
+		r[0] = bigint_divrem_1(q, a, an, d[0]);
+		return;
+	}
+
+	// Normalize so the divisor's top bit is set.  The dividend gets an
+	// extra limb, so the quotient always fits.
+	//
+	int shift = leading_zeros(d[dn-1]);
+	LIMB* work = new LIMB[an+1+dn];
+	LIMB* u = work;
+	LIMB* v = &work[an+1];
+	if (shift)
+	{
+		lshift_limbs(v, d, dn, shift);
+		u[an] = lshift_limbs(u, a, an, shift);
+	}
+	else
+	{
+		memcpy(v, d, dn*LIMBBYTES);
+		memcpy(u, a, an*LIMBBYTES);
+		u[an] = 0;
+	}
+	LIMB vinv = reciprocal_limb(v[dn-1]);
+
+	// Big quotients are found dn limbs at a time from the top, each piece
+	// dividing the remainder so far with the next dn limbs appended
+	//
+	long m = an+1-dn;
+	while (m > dn)
+	{
+		m -= dn;
+		recursive_divrem(&q[m], &u[m], dn, v, dn, vinv);
+	}
+	recursive_divrem(q, u, m, v, dn, vinv);
+
+	if (shift)
+		rshift_limbs(r, u, dn, shift);
+	else
+		memcpy(r, u, dn*LIMBBYTES);
+	delete[] work;
+}
+
+
+
+// Kernel selection
+
+static bool cpu_supports(const BigIntKernels* kernels)
+{
+#if HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (kernels == &adx_kernels)
+		return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+	if (kernels == &ifma_kernels)	// falls back on adx for small operands
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma") &&
+			__builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+	if (kernels == &avx2_kernels)
+		return __builtin_cpu_supports("avx2");
+#endif
+	return kernels == &portable_kernels;
+}
+
+// All of the kernel sets compiled in, best first.  The AVX2 kernels come
+// after the portable ones: four 26-bit lanes don't keep up with a scalar
+// 64-bit multiplier on the CPUs we've measured, so they're only used
+// when asked for by name.
+//
+static const BigIntKernels* all_kernels[] =
+{
+#if HAVE_X86_KERNELS
+	&ifma_kernels,
+	&adx_kernels,
+#endif
+	&portable_kernels,
+#if HAVE_X86_KERNELS
+	&avx2_kernels,
+#endif
+	NULL
+};
+
+// Pick the best kernels this CPU can run, unless the BIGINT_KERNELS
+// environment variable names a specific (supported) set.
+//
+static const BigIntKernels* default_kernels()
+{
+	const char* wanted = getenv("BIGINT_KERNELS");
+	for (int i=0; wanted && all_kernels[i]; i++)
+		if (!strcmp(wanted, all_kernels[i]->name) && cpu_supports(all_kernels[i]))
+			return all_kernels[i];
+
+	for (int i=0; all_kernels[i]; i++)
+		if (cpu_supports(all_kernels[i]))
+			return all_kernels[i];
+
+	return &portable_kernels;
+}
+
+static void set_kernels(const BigIntKernels* kernels)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__atomic_store_n(&bigint_kernels_in_use, kernels, __ATOMIC_RELEASE);
+#else
+	bigint_kernels_in_use = kernels;
+#endif
+}
+
+// The portable kernels need no setting up, so they're in place from the
+// start (this is constant initialization), and BigInts built by static
+// constructors in other files, which may run before this file's, work.
+// The best kernels for the CPU take over once this file is initialized.
+//
+const BigIntKernels* bigint_kernels_in_use = &portable_kernels;
+static const bool kernels_picked = (set_kernels(default_kernels()), true);
+
+LIMB bigint_montgomery_inverse(LIMB m)
+{
+	// Newton's iteration doubles the number of correct low bits each
+	// time; m itself is right to three bits for any odd m.
+	LIMB inv = m;
+	for (int i=0; i<5; i++)
+		inv *= 2 - m*inv;
+	return -inv;
+}
+
+bool bigint_select_kernels(const char* name)
+{
+	for (int i=0; all_kernels[i]; i++)
+	{
+		if (!strcmp(name, all_kernels[i]->name))
+		{
+			if (!cpu_supports(all_kernels[i]))
+				return false;
+			set_kernels(all_kernels[i]);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  c-file-offsets: ((substatement-open . 0))
+ * End:
+ */
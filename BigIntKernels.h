@@ -0,0 +1,98 @@
+#ifndef __BIGINTKERNELS_H
+#define __BIGINTKERNELS_H
+#include <inttypes.h>
+
+// Low-level arithmetic kernels used by BigInt for its inner loops.
+//
+// The kernels work on arrays of 64-bit limbs stored least significant
+// limb first, independent of the DIGIT size BigInt was compiled with.
+// BigInt packs its digits into limbs before calling a kernel and unpacks
+// the result afterwards, so the cost of the conversion is linear while
+// the work done in the kernel is quadratic.
+//
+// Several implementations of each kernel may be compiled in.  The best
+// one the CPU supports is chosen once when the library is loaded; the
+// portable C implementation is always available as a fallback, and is
+// what's used until then.
+
+#define LIMB uint64_t
+#define LIMBBITS 64
+#define LIMBBYTES 8
+
+struct BigIntKernels
+{
+	const char* name;
+
+	// r[0..an+bn-1] = a[0..an-1] * b[0..bn-1].  Requires an >= bn >= 1,
+	// and r must not overlap a or b.
+	void (*mul)(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn);
+
+	// r[0..2n-1] = a[0..n-1]^2.  r must not overlap a.
+	void (*sqr)(LIMB* r, const LIMB* a, long n);
+
+	// r[0..n-1] += a[0..n-1] * b, returning the carry out of the top limb.
+	LIMB (*addmul_1)(LIMB* r, const LIMB* a, long n, LIMB b);
+
+	// Montgomery multiplication: r[0..n-1] = a * b / 2^(64n) mod m, where
+	// m is odd, a and b are less than m, and minv is -1/m mod 2^64.  r may
+	// be the same array as a or b.
+	void (*montmul)(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+					long n, LIMB minv);
+
+	// Independent Montgomery multiplications done side by side, one per
+	// vector lane, or zero lanes if there's no such kernel.  Values are
+	// n digits of lanebits bits each, interleaved so that digit j of lane
+	// l is at [j*lanes+l].  Each lane computes a * b / 2^(lanebits*n) mod
+	// m with its own odd m, and its own minv = -1/m mod 2^lanebits.  a and
+	// b must be less than m, and r may be the same array as a or b.  The
+	// column sums are kept in 64 bits, which is enough for moduli of up to
+	// 16384 bits.
+	int lanes;
+	int lanebits;
+	void (*montmul_lanes)(uint64_t* r, const uint64_t* a, const uint64_t* b,
+						  const uint64_t* m, long n, const uint64_t* minv);
+};
+
+// The kernels currently in use.  They can be switched at any time, from
+// any thread, so anything that needs the same set throughout (the lane
+// layout, say) should read this once and hold on to it.
+extern const BigIntKernels* bigint_kernels_in_use;
+static inline const BigIntKernels* bigint_kernels()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_load_n(&bigint_kernels_in_use, __ATOMIC_ACQUIRE);
+#else
+	return bigint_kernels_in_use;
+#endif
+}
+
+// Returns -1/m mod 2^64 for odd m, as needed by montmul.
+LIMB bigint_montgomery_inverse(LIMB m);
+
+// r[0..an+bn-1] = a[0..an-1] * b[0..bn-1], and r[0..2n-1] = a[0..n-1]^2,
+// through the current kernels, using Karatsuba's method for big operands.
+// r must not overlap a or b.
+void bigint_mul(LIMB* r, const LIMB* a, long an, const LIMB* b, long bn);
+void bigint_sqr(LIMB* r, const LIMB* a, long n);
+
+// q[0..n-1] = a[0..n-1] / d, returning the remainder.  q may be a.
+LIMB bigint_divrem_1(LIMB* q, const LIMB* a, long n, LIMB d);
+
+// q[0..an-dn] = a / d and r[0..dn-1] = a % d, for an >= dn and a non-zero
+// top limb d[dn-1].  Neither q nor r may overlap a or d.
+void bigint_divrem(LIMB* q, LIMB* r, const LIMB* a, long an, const LIMB* d, long dn);
+
+// Select a kernel set by name ("portable", "adx", ...).  Returns false,
+// leaving the current selection alone, if the name is unknown or the CPU
+// does not support it.
+bool bigint_select_kernels(const char* name);
+
+#endif
+
+/*
+ * Local variables:
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  c-file-offsets: ((substatement-open . 0))
+ * End:
+ */
@@ -0,0 +1,392 @@
+#ifndef __FIXEDBIGINT_H
+#define __FIXEDBIGINT_H
+#include "BigInt.h"
+#include "BigIntKernels.h"
+
+// Fixed-width unsigned integers for hot loops on numbers of a known size,
+// such as 256-bit curve fields or 2048- and 4096-bit RSA moduli.
+//
+// A FixedBigInt<Bits> holds Bits bits, rounded up to whole 64-bit limbs,
+// inline: there's no allocation, no sign and no msd/lsd bookkeeping, and
+// every loop runs a compile-time number of times, so the compiler can
+// unroll it.  Arithmetic wraps modulo 2^(64*LIMBS) and reports the carry
+// or borrow, like the kernels.  Convert from and to BigInt at the edges
+// of the loop.
+//
+// With C++14 the arithmetic is constexpr, and constants can be written
+// as literals (see _big at the end), so a modulus and the values derived
+// from it are worked out by the compiler and stored read-only.
+
+#if __cplusplus >= 201402L
+#define FIXED_CONSTEXPR constexpr
+#else
+#define FIXED_CONSTEXPR
+#endif
+
+template <int Bits>
+class FixedBigInt
+{
+public:
+	enum { LIMBS = (Bits + LIMBBITS-1) / LIMBBITS };
+	typedef FixedBigInt<2*LIMBS*LIMBBITS> Wide;
+
+	LIMB limb[LIMBS];	// least significant first
+
+public:		// constructors
+	FIXED_CONSTEXPR FixedBigInt() : limb()
+	{
+	}
+
+	FIXED_CONSTEXPR FixedBigInt(LIMB value) : limb()
+	{
+		limb[0] = value;
+	}
+
+	// Widening from a narrower FixedBigInt, such as a literal.  Narrowing
+	// doesn't compile.
+	//
+	template <int FromBits>
+	FIXED_CONSTEXPR FixedBigInt(const FixedBigInt<FromBits>& x) : limb()
+	{
+		typedef char widening_only[(int)FixedBigInt<FromBits>::LIMBS <= (int)LIMBS ? 1 : -1];
+		(void)sizeof(widening_only);
+		for (int i=0; i<FixedBigInt<FromBits>::LIMBS; i++)
+			limb[i] = x.limb[i];
+	}
+
+public:		// methods
+	// Conversion, to and from any width of BasicBigInt.  from_bigint()
+	// fails, leaving the value alone, if bi is negative or doesn't fit.
+	//
+	template <typename Digit, typename TwoDigits>
+	bool from_bigint(const BasicBigInt<Digit, TwoDigits>& bi)
+	{
+		if (bi.is_negative() || bi.limb_count() > LIMBS)
+			return false;
+		bi.to_limbs(limb, LIMBS);
+		return true;
+	}
+
+	template <typename Digit, typename TwoDigits>
+	bool to_bigint(BasicBigInt<Digit, TwoDigits>* result) const
+	{
+		return result->from_limbs(limb, LIMBS, false);
+	}
+
+	BigInt to_bigint() const
+	{
+		BigInt result;
+		to_bigint(&result);
+		return result;
+	}
+
+	// Comparison
+	FIXED_CONSTEXPR int compare(const FixedBigInt& b) const
+	{
+		for (int i=LIMBS-1; i>=0; i--)
+			if (limb[i] != b.limb[i])
+				return (limb[i] < b.limb[i]) ? -1 : 1;
+		return 0;
+	}
+
+	FIXED_CONSTEXPR bool operator==(const FixedBigInt& b) const { return compare(b) == 0; }
+	FIXED_CONSTEXPR bool operator!=(const FixedBigInt& b) const { return compare(b) != 0; }
+	FIXED_CONSTEXPR bool operator<(const FixedBigInt& b) const { return compare(b) < 0; }
+
+	// The number of significant bits, or 0 for zero
+	//
+	FIXED_CONSTEXPR long num_bits() const
+	{
+		int i = LIMBS-1;
+		while (i > 0 && !limb[i])
+			i--;
+		long bits = (long)i*LIMBBITS;
+		for (LIMB top=limb[i]; top; top>>=1)
+			bits++;
+		return bits;
+	}
+
+	FIXED_CONSTEXPR bool zero() const
+	{
+		LIMB any = 0;
+		for (int i=0; i<LIMBS; i++)
+			any |= limb[i];
+		return !any;
+	}
+
+	// Addition and subtraction, in place, returning the carry or borrow
+	// out of the top limb.
+	//
+	FIXED_CONSTEXPR LIMB add(const FixedBigInt& b)
+	{
+		LIMB carry = 0;
+		for (int i=0; i<LIMBS; i++)
+		{
+			LIMB s = limb[i] + carry;
+			carry = (s < carry);
+			limb[i] = s + b.limb[i];
+			carry += (limb[i] < s);
+		}
+		return carry;
+	}
+
+	FIXED_CONSTEXPR LIMB sub(const FixedBigInt& b)
+	{
+		LIMB borrow = 0;
+		for (int i=0; i<LIMBS; i++)
+		{
+			LIMB d = limb[i] - b.limb[i];
+			LIMB bout = (limb[i] < b.limb[i]);
+			limb[i] = d - borrow;
+			borrow = bout | (d < borrow);
+		}
+		return borrow;
+	}
+
+	// Multiplying and adding a single limb, for building values up
+	// digit by digit; each returns what carries out of the top.
+	//
+	FIXED_CONSTEXPR LIMB mul_word(LIMB w)
+	{
+		LIMB carry = 0;
+		for (int i=0; i<LIMBS; i++)
+			limb[i] = muladd_limb(limb[i], w, 0, &carry);
+		return carry;
+	}
+
+	FIXED_CONSTEXPR LIMB add_word(LIMB w)
+	{
+		for (int i=0; i<LIMBS && w; i++)
+		{
+			limb[i] += w;
+			w = (limb[i] < w);
+		}
+		return w;
+	}
+
+	// The same as values, wrapping around, for working out constants.
+	//
+	FIXED_CONSTEXPR FixedBigInt operator+(const FixedBigInt& b) const
+	{
+		FixedBigInt r = *this;
+		r.add(b);
+		return r;
+	}
+
+	FIXED_CONSTEXPR FixedBigInt operator-(const FixedBigInt& b) const
+	{
+		FixedBigInt r = *this;
+		r.sub(b);
+		return r;
+	}
+
+	// The full double-width product a * b.
+	//
+	static FIXED_CONSTEXPR Wide mul(const FixedBigInt& a, const FixedBigInt& b)
+	{
+		Wide r;
+		for (int j=0; j<LIMBS; j++)
+		{
+			LIMB carry = 0;
+			for (int i=0; i<LIMBS; i++)
+			{
+				LIMB hi = 0;
+				LIMB lo = mul_limb(a.limb[i], b.limb[j], &hi);
+				lo += carry;
+				hi += (lo < carry);
+				r.limb[i+j] += lo;
+				hi += (r.limb[i+j] < lo);
+				carry = hi;
+			}
+			r.limb[j+LIMBS] = carry;
+		}
+		return r;
+	}
+
+	// Montgomery multiplication: *this = a * b / 2^(64*LIMBS) mod m, for
+	// odd m with a and b less than m and minv = -1/m mod 2^64 (see
+	// bigint_montgomery_inverse()).  a, b and *this may be the same.
+	//
+	FIXED_CONSTEXPR void montmul(const FixedBigInt& a, const FixedBigInt& b, const FixedBigInt& m, LIMB minv)
+	{
+		montmul_limbs(limb, a.limb, b.limb, m.limb, LIMBS, minv);
+	}
+
+	// -1/m mod 2^64 for odd m: bigint_montgomery_inverse(), but usable in
+	// constants.
+	//
+	static FIXED_CONSTEXPR LIMB montgomery_inverse(LIMB m)
+	{
+		LIMB inv = m;
+		for (int i=0; i<5; i++)
+			inv *= 2 - m*inv;
+		return 0 - inv;
+	}
+
+	// R^2 mod m, where m is this value (odd and more than one) and R is
+	// 2^(64*LIMBS).  montmul() by it takes a value into Montgomery form.
+	//
+	FIXED_CONSTEXPR FixedBigInt montgomery_r2() const
+	{
+		// Double one 2*64*LIMBS times, reducing as we go
+		FixedBigInt r(1);
+		for (int i=0; i<2*LIMBS*LIMBBITS; i++)
+		{
+			LIMB top = r.limb[LIMBS-1] >> (LIMBBITS-1);
+			for (int j=LIMBS-1; j>0; j--)
+				r.limb[j] = (r.limb[j] << 1) | (r.limb[j-1] >> (LIMBBITS-1));
+			r.limb[0] <<= 1;
+			if (top || r.compare(*this) >= 0)
+				r.sub(*this);
+		}
+		return r;
+	}
+
+	// The same on bare arrays of LIMBS limbs, with the kernels' montmul
+	// signature so it can stand in for one (the length is always LIMBS).  This is the
+	// interleaved (CIOS) form, so the product is never held whole.
+	//
+	static FIXED_CONSTEXPR void montmul_limbs(LIMB* r, const LIMB* a, const LIMB* b, const LIMB* m,
+							  long, LIMB minv)
+	{
+		LIMB t[LIMBS+2] = {};
+		for (int j=0; j<LIMBS; j++)
+		{
+			// t += a * b[j]
+			LIMB carry = 0;
+			for (int i=0; i<LIMBS; i++)
+				t[i] = muladd_limb(a[i], b[j], t[i], &carry);
+			LIMB s = t[LIMBS] + carry;
+			t[LIMBS+1] = (s < carry);
+			t[LIMBS] = s;
+
+			// then add the multiple of m that clears t[0], and shift it out
+			LIMB q = t[0] * minv;
+			carry = 0;
+			muladd_limb(q, m[0], t[0], &carry);
+			for (int i=1; i<LIMBS; i++)
+				t[i-1] = muladd_limb(q, m[i], t[i], &carry);
+			s = t[LIMBS] + carry;
+			t[LIMBS-1] = s;
+			t[LIMBS] = t[LIMBS+1] + (s < carry);
+		}
+
+		// What's left is less than 2m, so at most one subtraction is needed
+		int top = LIMBS-1;
+		while (top >= 0 && t[top] == m[top])
+			top--;
+		bool over = t[LIMBS] || top < 0 || t[top] > m[top];
+		LIMB borrow = 0;
+		for (int i=0; i<LIMBS; i++)
+		{
+			LIMB sub = over ? m[i] : 0;
+			LIMB d = t[i] - sub;
+			LIMB bout = (t[i] < sub);
+			r[i] = d - borrow;
+			borrow = bout | (d < borrow);
+		}
+	}
+
+private:	// helpers
+	// a * b, returning the low limb and storing the high one in *hi.
+	//
+	static FIXED_CONSTEXPR inline LIMB mul_limb(LIMB a, LIMB b, LIMB* hi)
+	{
+#if defined(__SIZEOF_INT128__)
+		unsigned __int128 p = (unsigned __int128)a * b;
+		*hi = (LIMB)(p >> LIMBBITS);
+		return (LIMB)p;
+#else
+		uint64_t al = (uint32_t)a, ah = a >> 32;
+		uint64_t bl = (uint32_t)b, bh = b >> 32;
+		uint64_t ll = al*bl, lh = al*bh, hl = ah*bl, hh = ah*bh;
+		uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+		*hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+		return (mid << 32) | (uint32_t)ll;
+#endif
+	}
+
+	// a * b + c + *carry, returning the low limb and leaving the high one
+	// in *carry.  It can't overflow: (2^64-1)^2 + 2(2^64-1) < 2^128.
+	//
+	static FIXED_CONSTEXPR inline LIMB muladd_limb(LIMB a, LIMB b, LIMB c, LIMB* carry)
+	{
+		LIMB hi = 0;
+		LIMB lo = mul_limb(a, b, &hi);
+		lo += c;
+		hi += (lo < c);
+		lo += *carry;
+		hi += (lo < *carry);
+		*carry = hi;
+		return lo;
+	}
+};
+
+#if __cplusplus >= 201402L
+
+// Integer literals of any length, in any of C++'s bases, with ' allowed
+// between digits: 0xffffffff00000001_big, 340282366920938463463374607431768211507_big.
+// The type is a FixedBigInt just wide enough for the value, which widens
+// to bigger ones as needed.
+
+// The base of a literal, and where its digits start
+//
+template <char... Chars>
+constexpr int fixed_literal_base(int* first)
+{
+	const char s[] = { Chars... };
+	int n = sizeof...(Chars);
+	*first = 2;
+	if (n > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		return 16;
+	if (n > 2 && s[0] == '0' && (s[1] == 'b' || s[1] == 'B'))
+		return 2;
+	*first = (n > 1 && s[0] == '0');
+	return *first ? 8 : 10;
+}
+
+template <int Bits, char... Chars>
+constexpr FixedBigInt<Bits> fixed_literal()
+{
+	const char s[] = { Chars... };
+	int first = 0;
+	int base = fixed_literal_base<Chars...>(&first);
+	FixedBigInt<Bits> r;
+	for (int i=first; i<(int)sizeof...(Chars); i++)
+	{
+		char c = s[i];
+		if (c == '\'')
+			continue;
+		r.mul_word(base);
+		r.add_word(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+	}
+	return r;
+}
+
+// The bits the value needs, found by reading it at four bits a digit,
+// which is always enough
+//
+template <char... Chars>
+constexpr int fixed_literal_bits()
+{
+	long bits = fixed_literal<4*sizeof...(Chars), Chars...>().num_bits();
+	return bits ? bits : 1;
+}
+
+template <char... Chars>
+constexpr FixedBigInt<fixed_literal_bits<Chars...>()> operator"" _big()
+{
+	return fixed_literal<fixed_literal_bits<Chars...>(), Chars...>();
+}
+
+#endif
+
+#endif
+
+/*
+ * Local variables:
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  c-file-offsets: ((substatement-open . 0))
+ * End:
+ */
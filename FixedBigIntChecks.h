@@ -0,0 +1,34 @@
+#ifndef __FIXEDBIGINTCHECKS_H
+#define __FIXEDBIGINTCHECKS_H
+#include "FixedBigInt.h"
+
+// Compile-time checks of FixedBigInt's constexpr arithmetic and literals,
+// for C++14 and later.  Included once, from BigInt.cpp.
+
+static_assert(0xffff'ffff'0000'0001_big == FixedBigInt<64>(0xffffffff00000001ULL), "hex literal");
+static_assert(0b1010'1010_big == FixedBigInt<8>(170), "binary literal");
+static_assert(0777_big == FixedBigInt<9>(511), "octal literal");
+static_assert((340282366920938463463374607431768211507_big).limb[0] == 51 &&
+			  (340282366920938463463374607431768211507_big).limb[1] == 0 &&
+			  (340282366920938463463374607431768211507_big).limb[2] == 1, "decimal literal");
+
+// R^2 mod m, with R = 2^64 and m = 2^61-1, is 2^128 mod 2^61-1 = 2^6
+static_assert(FixedBigInt<64>(0x1fffffffffffffffULL).montgomery_r2() == FixedBigInt<64>(64),
+			  "montgomery_r2");
+static_assert(FixedBigInt<64>::mul(FixedBigInt<64>(0xffffffffffffffffULL),
+								   FixedBigInt<64>(0xffffffffffffffffULL)) ==
+			  0xffff'ffff'ffff'fffe'0000'0000'0000'0001_big, "mul");
+static_assert(FixedBigInt<128>(0xffffffffffffffffULL) + FixedBigInt<128>(1) ==
+			  0x1'0000'0000'0000'0000_big, "operator+ carry");
+static_assert(0x1'0000'0000'0000'0000_big - FixedBigInt<65>(1) ==
+			  FixedBigInt<65>(0xffffffffffffffffULL), "operator- borrow");
+
+#endif
+
+/*
+ * Local variables:
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  c-file-offsets: ((substatement-open . 0))
+ * End:
+ */
@@ -35,11 +35,30 @@ extern "C" {
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 };
 
 #include "BigInt.h"
 #include "common.h"
 
+#if LUA_VERSION_NUM == 501
+#define lua_rawlen lua_objlen
+
+// Lua 5.1 can't size a buffer up front, so output goes into a scratch
+// userdata (collected like any other) and is pushed from there.
+static char *luaL_buffinitsize(lua_State *L, luaL_Buffer *B, size_t size)
+{
+  B->L = L;
+  return (char *)lua_newuserdata(L, size);
+}
+
+static void luaL_pushresultsize(luaL_Buffer *B, size_t size)
+{
+  lua_pushlstring(B->L, (const char *)lua_touserdata(B->L, -1), size);
+  lua_remove(B->L, -2);
+}
+#endif
+
 static bool _isBigInt(lua_State *L, int index)
 {
   if (lua_type(L, index) != LUA_TUSERDATA)
@@ -64,7 +83,9 @@ static BigInt *_checkBigInt(lua_State *L, int index)
   return *b;
 }
 
-extern "C" void construct_bigint(lua_State *L, int argidx)
+// As construct_bigint, but strings are read as digits in the given base
+// (from 2 to 36) rather than as decimal or 0x-prefixed hex.
+extern "C" void construct_bigint_base(lua_State *L, int argidx, int base)
 {
   BigInt **b = (BigInt **)lua_newuserdata(L, sizeof(BigInt *));
 
@@ -75,7 +96,13 @@ extern "C" void construct_bigint(lua_State *L, int argidx)
     *b = new BigInt((long)lua_tointeger(L, argidx));
     break;
   case LUA_TSTRING:
-    *b = new BigInt(lua_tostring(L, argidx));
+    *b = new BigInt;
+    if (base == 10 ? !(**b = lua_tostring(L, argidx))
+	: !(*b)->from_string(lua_tostring(L, argidx), base)) {
+      delete *b;
+      luaL_error(L, "malformed number '%s' for BigInt.new", lua_tostring(L, argidx));
+      return;
+    }
     break;
   case LUA_TUSERDATA:
     {
@@ -97,14 +124,22 @@ extern "C" void construct_bigint(lua_State *L, int argidx)
   lua_setmetatable(L, -2);             
 }
 
+extern "C" void construct_bigint(lua_State *L, int argidx)
+{
+  construct_bigint_base(L, argidx, 10);
+}
+
 extern "C" int bigint_new(lua_State *L)
 {
-  // Starting with the simple case: 1 argument (a string)
-  if (lua_gettop(L) != 1 && lua_gettop(L) != 2) {
-    return luaL_error(L, "expect 2 args to new(class, value)");
+  // Starting with the simple case: 1 argument (a string), optionally
+  // followed by the base it's written in
+  if (lua_gettop(L) < 1 || lua_gettop(L) > 3) {
+    return luaL_error(L, "expect 2 or 3 args to new(class, value [, base])");
   }
+  int base = (int)luaL_optinteger(L, 3, 10);
+  luaL_argcheck(L, base >= 2 && base <= 36, 3, "base must be from 2 to 36");
   // allocate memory for a pointer to a C++ object
-  construct_bigint(L, 2);
+  construct_bigint_base(L, 2, base);
 
   return 1; // return the BIGINT_POINTER userdata
 }
@@ -122,6 +157,54 @@ static BigInt *_getnum(lua_State *L, int index)
   return b;
 }
 
+// If the value at index is a Lua number holding an integer that fits in a
+// long, store it in *value and return true; BigInt's long operators take
+// the single-word path when they can.  Lua integers are read as such, since
+// going through a double would round anything above 2^53.  For floats,
+// -(lua_Number)LONG_MIN is the upper bound since LONG_MAX itself may round
+// up when converted.
+static bool _getsmall(lua_State *L, int index, long *value)
+{
+  if (lua_type(L, index) != LUA_TNUMBER)
+    return false;
+#if LUA_VERSION_NUM >= 503
+  if (lua_isinteger(L, index)) {
+    lua_Integer i = lua_tointegerx(L, index, NULL);
+    if (i < LONG_MIN || i > LONG_MAX)
+      return false;
+    *value = (long)i;
+    return true;
+  }
+#endif
+  lua_Number n = lua_tonumber(L, index);
+  if (!(n >= (lua_Number)LONG_MIN && n < -(lua_Number)LONG_MIN))
+    return false;
+  if (n != (lua_Number)(long)n)
+    return false;
+  *value = (long)n;
+  return true;
+}
+
+// A shift count or bit number, which the __shl and __shr metamethods may
+// hand us as a bigint.
+static long _getcount(lua_State *L, int index)
+{
+  if (_isBigInt(L, index))
+    return _checkBigInt(L, index)->long_value();
+  return (long)lua_tonumber(L, index);
+}
+
+// A bit number, which must not be negative.
+static unsigned long _getbit(lua_State *L, int index)
+{
+  long n = _getcount(L, index);
+  if (n < 0) {
+    lua_pushstring(L, "bit numbers must not be negative");
+    lua_error(L);
+  }
+  return (unsigned long)n;
+}
+
 extern "C" int bigint_destroy(lua_State *L)
 {
   BigInt *b = _checkBigInt(L, 1);
@@ -133,8 +216,22 @@ extern "C" int bigint_destroy(lua_State *L)
 extern "C" int bigint_tostring(lua_State *L)
 {
   BigInt *b1 = _checkBigInt(L, 1);
+  int base = (int)luaL_optinteger(L, 2, 10);
+  luaL_argcheck(L, base >= 2 && base <= 36, 2, "base must be from 2 to 36");
+
+  // Decimal is what __tostring and __concat want, over and over for the
+  // same value, so it's converted once and kept on the BigInt
+  if (base == 10) {
+    long length;
+    const char *s = b1->cached_decimal(&length);
+    lua_pushlstring(L, s, length);
+    return 1;
+  }
 
-  lua_pushstring(L, b1->decimal_string_value());
+  // Written straight into the Lua string's buffer
+  luaL_Buffer buf;
+  char *s = luaL_buffinitsize(L, &buf, b1->to_string_size(base));
+  luaL_pushresultsize(&buf, b1->to_string(s, base));
   return 1;
 }
 
@@ -142,7 +239,180 @@ extern "C" int bigint_raw(lua_State *L)
 {
   BigInt *b1 = _checkBigInt(L, 1);
   
-  lua_pushlstring(L, (const char *)b1->byte_array_value(), b1->byte_length());
+  luaL_Buffer buf;
+  long length = b1->byte_length();
+  char *s = luaL_buffinitsize(L, &buf, length);
+  b1->byte_array_value((unsigned char *)s, length);
+  luaL_pushresultsize(&buf, length);
+  return 1;
+}
+
+extern "C" int bigint_fromraw(lua_State *L)
+{
+  // Big-endian bytes, as from raw(); if signed is set, they're two's
+  // complement
+  size_t length;
+  const char *s = luaL_checklstring(L, 1, &length);
+  bool is_signed = lua_toboolean(L, 2);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  BigInt *b = _checkBigInt(L, -1);
+  if (is_signed)
+    b->copy_signed_bytes((const unsigned char *)s, length);
+  else
+    b->copy_bytes((const unsigned char *)s, length);
+  return 1;
+}
+
+extern "C" int bigint_frommpint(lua_State *L)
+{
+  // An SSH mpint: a 32-bit big-endian length, then that many bytes of
+  // two's complement.  The length must cover the rest of the string
+  // exactly.
+  size_t length;
+  const unsigned char *s = (const unsigned char *)luaL_checklstring(L, 1, &length);
+  if (length < 4 ||
+      (((size_t)s[0]<<24) | ((size_t)s[1]<<16) | ((size_t)s[2]<<8) | s[3]) != length-4)
+    return luaL_error(L, "malformed mpint for frommpint");
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  _checkBigInt(L, -1)->copy_signed_bytes(&s[4], length-4);
+  return 1;
+}
+
+extern "C" int bigint_mpint(lua_State *L)
+{
+  BigInt *b1 = _checkBigInt(L, 1);
+
+  luaL_Buffer buf;
+  long length = b1->MPint_length();
+  char *s = luaL_buffinitsize(L, &buf, length);
+  b1->MPint_value((unsigned char *)s);
+  luaL_pushresultsize(&buf, length);
+  return 1;
+}
+
+// The bytes tobytes needs for a value: those of the magnitude, except that
+// a negative value needs room for its sign bit as well, unless it's minus
+// a power of two (-128 fits in one byte, but -129 needs two).
+static long _bytesneeded(BigInt *b)
+{
+  if (!b->is_negative())
+    return b->byte_length();
+  unsigned long bits = b->num_bits();
+  if (b->ctz() + 1 != bits)
+    bits++;
+  return (long)((bits + 7) / 8);
+}
+
+extern "C" int bigint_tobytes(lua_State *L)
+{
+  // Exactly len bytes (by default, as many as the value needs), big- or
+  // little-endian; negative values are in two's complement
+  static const char *const endians[] = { "big", "little", NULL };
+  BigInt *b1 = _checkBigInt(L, 1);
+  long needed = _bytesneeded(b1);
+  long length = (long)luaL_optinteger(L, 2, needed);
+  bool little = (luaL_checkoption(L, 3, "big", endians) == 1);
+  luaL_argcheck(L, length >= needed, 2, "too short to hold the value");
+
+  luaL_Buffer buf;
+  unsigned char *s = (unsigned char *)luaL_buffinitsize(L, &buf, length);
+  b1->byte_array_value(s, length);
+  if (little) {
+    for (long i=0, j=length-1; i<j; i++, j--) {
+      unsigned char t = s[i];
+      s[i] = s[j];
+      s[j] = t;
+    }
+  }
+  luaL_pushresultsize(&buf, length);
+  return 1;
+}
+
+// Where b:write() sends its pieces: a function to call with each one, or
+// an object (like a file handle) whose write method takes them.
+struct _writer {
+  lua_State *L;
+  int index;
+  bool method;
+  bool error;
+};
+
+static bool _flushWriter(void *context, const char *s, long len)
+{
+  _writer *w = (_writer *)context;
+  lua_State *L = w->L;
+  if (w->method) {
+    lua_getfield(L, w->index, "write");
+    lua_pushvalue(L, w->index);
+  } else {
+    lua_pushvalue(L, w->index);
+  }
+  lua_pushlstring(L, s, len);
+  // Errors are caught here and raised once the BigInt side has cleaned
+  // up; the message is left on the stack
+  if (lua_pcall(L, w->method ? 2 : 1, 1, 0)) {
+    w->error = true;
+    return false;
+  }
+  // A write method returns nil when it fails, and a function can return
+  // false to stop
+  bool ok = w->method ? !lua_isnil(L, -1)
+    : !(lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+  lua_pop(L, 1);
+  return ok;
+}
+
+extern "C" int bigint_write(lua_State *L)
+{
+  // Stream the decimal value to a file handle, anything else with a
+  // write method, or a function, without building the whole string
+  BigInt *b1 = _checkBigInt(L, 1);
+  bool ok;
+#if LUA_VERSION_NUM >= 502
+  luaL_Stream *stream = (luaL_Stream *)luaL_testudata(L, 2, LUA_FILEHANDLE);
+  if (stream && stream->closef) {
+    ok = b1->write_decimal(stream->f);
+    lua_pushboolean(L, ok);
+    return 1;
+  }
+#endif
+  luaL_checkany(L, 2);
+  _writer w = { L, 2, lua_type(L, 2) != LUA_TFUNCTION, false };
+  ok = b1->write_decimal(_flushWriter, &w);
+  if (w.error)
+    return lua_error(L);
+  lua_pushboolean(L, ok);
+  return 1;
+}
+
+extern "C" int bigint_save(lua_State *L)
+{
+  // Like io functions, failure returns nil and a message
+  BigInt *b1 = _checkBigInt(L, 1);
+  const char *path = luaL_checkstring(L, 2);
+  if (!b1->save(path)) {
+    lua_pushnil(L);
+    lua_pushfstring(L, "%s: can't write BigInt file", path);
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+extern "C" int bigint_load(lua_State *L)
+{
+  const char *path = luaL_checkstring(L, 1);
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  if (!_checkBigInt(L, -1)->load_mmap(path)) {
+    lua_pushnil(L);
+    lua_pushfstring(L, "%s: can't read BigInt file", path);
+    return 2;
+  }
   return 1;
 }
 
@@ -197,6 +467,13 @@ extern "C" int bigint_add(lua_State *L)
   }
 
   BigInt *b1 = _getnum(L, 1);
+  long small;
+  if (_getsmall(L, 2, &small)) {
+    lua_pushliteral(L, "0");
+    construct_bigint(L, -1);
+    *_checkBigInt(L, -1) = *b1 + small;
+    return 1;
+  }
   BigInt *b2 = _getnum(L, 2);
 
   lua_pushliteral(L, "0");
@@ -217,6 +494,13 @@ extern "C" int bigint_sub(lua_State *L)
   }
 
   BigInt *b1 = _getnum(L, 1);
+  long small;
+  if (_getsmall(L, 2, &small)) {
+    lua_pushliteral(L, "0");
+    construct_bigint(L, -1);
+    *_checkBigInt(L, -1) = *b1 - small;
+    return 1;
+  }
   BigInt *b2 = _getnum(L, 2);
 
   lua_pushliteral(L, "0");
@@ -236,6 +520,13 @@ extern "C" int bigint_mul(lua_State *L)
   }
 
   BigInt *b1 = _getnum(L, 1);
+  long small;
+  if (_getsmall(L, 2, &small)) {
+    lua_pushliteral(L, "0");
+    construct_bigint(L, -1);
+    *_checkBigInt(L, -1) = *b1 * small;
+    return 1;
+  }
   BigInt *b2 = _getnum(L, 2);
 
   lua_pushliteral(L, "0");
@@ -255,6 +546,13 @@ extern "C" int bigint_div(lua_State *L)
   }
 
   BigInt *b1 = _getnum(L, 1);
+  long small;
+  if (_getsmall(L, 2, &small)) {
+    lua_pushliteral(L, "0");
+    construct_bigint(L, -1);
+    *_checkBigInt(L, -1) = *b1 / small;
+    return 1;
+  }
   BigInt *b2 = _getnum(L, 2);
 
   lua_pushliteral(L, "0");
@@ -265,6 +563,27 @@ extern "C" int bigint_div(lua_State *L)
   return 1;
 }
 
+extern "C" int bigint_divexact(lua_State *L)
+{
+  // Like div, but only for divisions known to leave no remainder
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "divexact requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  BigInt *b2 = _getnum(L, 2);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = *b1;
+  ret->divexact(*b2);
+  return 1;
+}
+
 extern "C" int bigint_mod(lua_State *L)
 {
   if (lua_gettop(L) != 2) {
@@ -274,6 +593,13 @@ extern "C" int bigint_mod(lua_State *L)
   }
 
   BigInt *b1 = _getnum(L, 1);
+  long small;
+  if (_getsmall(L, 2, &small)) {
+    lua_pushliteral(L, "0");
+    construct_bigint(L, -1);
+    *_checkBigInt(L, -1) = *b1 % small;
+    return 1;
+  }
   BigInt *b2 = _getnum(L, 2);
 
   lua_pushliteral(L, "0");
@@ -400,6 +726,64 @@ extern "C" int bigint_expmod(lua_State *L)
   return 1;
 }
 
+extern "C" int bigint_expmod_many(lua_State *L)
+{
+  // expmod_many({a1, a2, ...}, {b1, b2, ...}, {c1, c2, ...}) returns the
+  // table {(a1^b1)%c1, (a2^b2)%c2, ...}
+  if (lua_gettop(L) != 3) {
+    return luaL_error(L, "expmod_many requires three tables ((a^b)%c)");
+  }
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  luaL_checktype(L, 3, LUA_TTABLE);
+
+  long count = (long)lua_rawlen(L, 1);
+  if ((long)lua_rawlen(L, 2) != count || (long)lua_rawlen(L, 3) != count) {
+    return luaL_error(L, "expmod_many requires tables of the same length");
+  }
+
+  // Convert the arguments, and make the results, before allocating the
+  // array below: _getnum and construct_bigint can raise errors, which
+  // would leak it.  The converted arguments go in a table at 4 to keep
+  // them alive, and the results table is at 5.
+  lua_createtable(L, (int)(3*count), 0);
+  for (long i=0; i<3*count; i++) {
+    lua_rawgeti(L, (int)(i/count) + 1, i%count + 1);
+    _getnum(L, -1);
+    lua_rawseti(L, 4, i+1);
+    lua_settop(L, 4);
+  }
+  lua_createtable(L, (int)count, 0);
+  for (long i=0; i<count; i++) {
+    lua_pushliteral(L, "0");
+    construct_bigint(L, -1);
+    lua_rawseti(L, 5, i+1);
+    lua_pop(L, 1);
+  }
+
+  BigInt *args = new BigInt[count*4 + 1];
+  for (long i=0; i<3*count; i++) {
+    lua_rawgeti(L, 4, i+1);
+    args[i] = *_checkBigInt(L, -1);
+    lua_pop(L, 1);
+  }
+
+  if (!BigInt::expmod_many(&args[0], &args[count], &args[2*count],
+			   &args[3*count], count)) {
+    delete[] args;
+    return luaL_error(L, "expmod_many: out of memory");
+  }
+
+  for (long i=0; i<count; i++) {
+    lua_rawgeti(L, 5, i+1);
+    *_checkBigInt(L, -1) = args[3*count + i];
+    lua_pop(L, 1);
+  }
+
+  delete[] args;
+  return 1;
+}
+
 extern "C" int bigint_inv(lua_State *L)
 {
   if (lua_gettop(L) != 2) {
@@ -447,7 +831,7 @@ extern "C" int bigint_shiftleft(lua_State *L)
   }
 
   BigInt *b1 = _getnum(L, 1);
-  long b2 = lua_tonumber(L, 2);
+  long b2 = _getcount(L, 2);
 
   lua_pushliteral(L, "0");
   construct_bigint(L, -1);
@@ -467,7 +851,7 @@ extern "C" int bigint_shiftright(lua_State *L)
   }
 
   BigInt *b1 = _getnum(L, 1);
-  long b2 = lua_tonumber(L, 2);
+  long b2 = _getcount(L, 2);
 
   lua_pushliteral(L, "0");
   construct_bigint(L, -1);
@@ -478,3 +862,372 @@ extern "C" int bigint_shiftright(lua_State *L)
   return 1;
 }
 
+extern "C" int bigint_band(lua_State *L)
+{
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "and requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  BigInt *b2 = _getnum(L, 2);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = *b1 & *b2;
+  return 1;
+}
+
+extern "C" int bigint_bor(lua_State *L)
+{
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "or requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  BigInt *b2 = _getnum(L, 2);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = *b1 | *b2;
+  return 1;
+}
+
+extern "C" int bigint_bxor(lua_State *L)
+{
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "xor requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  BigInt *b2 = _getnum(L, 2);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = *b1 ^ *b2;
+  return 1;
+}
+
+extern "C" int bigint_bnot(lua_State *L)
+{
+  // Like __unm, __bnot gets its operand twice.
+  if (lua_gettop(L) != 1 && lua_gettop(L) != 2) {
+    lua_pushstring(L, "not requires one argument");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = ~*b1;
+  return 1;
+}
+
+extern "C" int bigint_testbit(lua_State *L)
+{
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "testbit requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  lua_pushboolean(L, b1->testbit(_getbit(L, 2)));
+  return 1;
+}
+
+extern "C" int bigint_setbit(lua_State *L)
+{
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "setbit requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  unsigned long bit = _getbit(L, 2);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = *b1;
+  ret->setbit(bit);
+  return 1;
+}
+
+extern "C" int bigint_clearbit(lua_State *L)
+{
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "clearbit requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  unsigned long bit = _getbit(L, 2);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = *b1;
+  ret->clearbit(bit);
+  return 1;
+}
+
+extern "C" int bigint_popcount(lua_State *L)
+{
+  BigInt *b1 = _getnum(L, 1);
+  lua_pushinteger(L, b1->popcount());
+  return 1;
+}
+
+extern "C" int bigint_ctz(lua_State *L)
+{
+  BigInt *b1 = _getnum(L, 1);
+  lua_pushinteger(L, b1->ctz());
+  return 1;
+}
+
+extern "C" int bigint_numbits(lua_State *L)
+{
+  BigInt *b1 = _getnum(L, 1);
+  lua_pushinteger(L, b1->num_bits());
+  return 1;
+}
+
+extern "C" int bigint_isqrt(lua_State *L)
+{
+  if (lua_gettop(L) != 1) {
+    lua_pushstring(L, "isqrt requires one argument");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  if (b1->is_negative()) {
+    lua_pushstring(L, "isqrt of a negative number");
+    lua_error(L);
+    return 0;
+  }
+
+  // Each result replaces the literal it was made from, so the two are
+  // left on top of the stack
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  lua_remove(L, -2);
+  BigInt *root = _checkBigInt(L, -1);
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  lua_remove(L, -2);
+  BigInt *rem = _checkBigInt(L, -1);
+
+  b1->isqrt_rem(root, rem);
+  return 2;
+}
+
+extern "C" int bigint_iroot(lua_State *L)
+{
+  if (lua_gettop(L) != 2) {
+    lua_pushstring(L, "iroot requires two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  long k = _getcount(L, 2);
+  if (k < 1 || (b1->is_negative() && !(k & 1))) {
+    lua_pushstring(L, "iroot needs a positive k, and an odd one for a negative number");
+    lua_error(L);
+    return 0;
+  }
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = b1->iroot(k);
+  return 1;
+}
+
+extern "C" int bigint_issquare(lua_State *L)
+{
+  BigInt *b1 = _getnum(L, 1);
+  lua_pushboolean(L, b1->is_square());
+  return 1;
+}
+
+// Returns the base and exponent if the argument is a perfect power, or
+// false if it isn't.
+extern "C" int bigint_isperfectpower(lua_State *L)
+{
+  BigInt *b1 = _getnum(L, 1);
+
+  BigInt base;
+  unsigned long exponent;
+  if (!b1->is_perfect_power(&base, &exponent)) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  lua_remove(L, -2);
+  *_checkBigInt(L, -1) = base;
+  lua_pushinteger(L, exponent);
+  return 2;
+}
+
+extern "C" int bigint_isprime(lua_State *L)
+{
+  if (lua_gettop(L) < 1 || lua_gettop(L) > 2) {
+    lua_pushstring(L, "isprime requires one or two arguments");
+    lua_error(L);
+    return 0;
+  }
+
+  int rounds = (int)luaL_optinteger(L, 2, 0);
+  BigInt *b1 = _getnum(L, 1);
+  lua_pushboolean(L, b1->is_probable_prime(rounds));
+  return 1;
+}
+
+extern "C" int bigint_nextprime(lua_State *L)
+{
+  if (lua_gettop(L) != 1) {
+    lua_pushstring(L, "nextprime requires one argument");
+    lua_error(L);
+    return 0;
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+
+  BigInt *ret = _checkBigInt(L, -1);
+  *ret = b1->next_prime();
+  return 1;
+}
+
+extern "C" int bigint_randomprime(lua_State *L)
+{
+  lua_Integer bits = luaL_checkinteger(L, 1);
+  if (bits < 2) {
+    lua_pushstring(L, "randomprime needs at least 2 bits");
+    lua_error(L);
+    return 0;
+  }
+
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  if (!_checkBigInt(L, -1)->random_prime((unsigned long)bits)) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "no random source");
+    return 2;
+  }
+  return 1;
+}
+
+extern "C" int bigint_factorize(lua_State *L)
+{
+  // factorize(n) returns the table of n's prime factors, smallest first
+  // and each as many times as it divides n
+  if (lua_gettop(L) != 1) {
+    return luaL_error(L, "factorize requires one argument");
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+  BigInt *factors = new BigInt[b1->num_bits() + 1];
+  long count = b1->factor(factors);
+
+  lua_createtable(L, (int)count, 0);
+  for (long i=0; i<count; i++) {
+    lua_pushliteral(L, "0");
+    construct_bigint(L, -1);
+    *_checkBigInt(L, -1) = factors[i];
+    lua_rawseti(L, -3, i+1);
+    lua_pop(L, 1);
+  }
+
+  delete[] factors;
+  return 1;
+}
+
+extern "C" int bigint_ecm(lua_State *L)
+{
+  // ecm(n [, B1 [, B2 [, curves]]]) returns a factor of n other than 1
+  // and n, found by the elliptic curve method, or nil if none of the
+  // curves found one.  The defaults suit factors of around 20 digits.
+  if (lua_gettop(L) < 1 || lua_gettop(L) > 4) {
+    return luaL_error(L, "ecm requires one to four arguments");
+  }
+
+  lua_Integer B1 = luaL_optinteger(L, 2, 11000);
+  lua_Integer B2 = luaL_optinteger(L, 3, 100*B1);
+  lua_Integer curves = luaL_optinteger(L, 4, 90);
+  if (B1 < 2 || B2 < 0 || curves < 1) {
+    return luaL_error(L, "ecm needs B1 of at least 2 and at least one curve");
+  }
+  BigInt *b1 = _getnum(L, 1);
+
+  BigInt factor;
+  if (!b1->ecm(&factor, (unsigned long)B1, (unsigned long)B2, (long)curves)) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  *_checkBigInt(L, -1) = factor;
+  return 1;
+}
+
+extern "C" int bigint_siqs(lua_State *L)
+{
+  // siqs(n) returns a factor of n other than 1 and n, found by the
+  // self-initializing quadratic sieve, or nil if n is prime
+  if (lua_gettop(L) != 1) {
+    return luaL_error(L, "siqs requires one argument");
+  }
+
+  BigInt *b1 = _getnum(L, 1);
+
+  BigInt factor;
+  if (!b1->siqs(&factor)) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_pushliteral(L, "0");
+  construct_bigint(L, -1);
+  *_checkBigInt(L, -1) = factor;
+  return 1;
+}
+
+extern "C" int bigint_kernel(lua_State *L)
+{
+  // With no arguments, report the arithmetic kernels in use; otherwise
+  // try to switch to the named ones.
+  if (lua_gettop(L) == 0) {
+    lua_pushstring(L, BigInt::kernels());
+    return 1;
+  }
+
+  lua_pushboolean(L, BigInt::use_kernels(luaL_checkstring(L, 1)));
+  return 1;
+}
@@ -7,12 +7,20 @@ int bigint_new(lua_State *L);
 int bigint_destroy(lua_State *L);
 int bigint_tostring(lua_State *L);
 int bigint_raw(lua_State *L);
+int bigint_fromraw(lua_State *L);
+int bigint_frommpint(lua_State *L);
+int bigint_mpint(lua_State *L);
+int bigint_tobytes(lua_State *L);
+int bigint_write(lua_State *L);
+int bigint_save(lua_State *L);
+int bigint_load(lua_State *L);
 int bigint_tonumber(lua_State *L);
 int bigint_concat(lua_State *L);
 int bigint_add(lua_State *L);
 int bigint_sub(lua_State *L);
 int bigint_mul(lua_State *L);
 int bigint_div(lua_State *L);
+int bigint_divexact(lua_State *L);
 int bigint_mod(lua_State *L);
 int bigint_pow(lua_State *L);
 int bigint_negate(lua_State *L);
@@ -20,9 +28,31 @@ int bigint_equal(lua_State *L);
 int bigint_lt(lua_State *L);
 int bigint_le(lua_State *L);
 int bigint_expmod(lua_State *L);
+int bigint_expmod_many(lua_State *L);
 int bigint_inv(lua_State *L);
 int bigint_gcd(lua_State *L);
 int bigint_shiftleft(lua_State *L);
 int bigint_shiftright(lua_State *L);
+int bigint_band(lua_State *L);
+int bigint_bor(lua_State *L);
+int bigint_bxor(lua_State *L);
+int bigint_bnot(lua_State *L);
+int bigint_testbit(lua_State *L);
+int bigint_setbit(lua_State *L);
+int bigint_clearbit(lua_State *L);
+int bigint_popcount(lua_State *L);
+int bigint_ctz(lua_State *L);
+int bigint_numbits(lua_State *L);
+int bigint_isqrt(lua_State *L);
+int bigint_iroot(lua_State *L);
+int bigint_issquare(lua_State *L);
+int bigint_isperfectpower(lua_State *L);
+int bigint_isprime(lua_State *L);
+int bigint_nextprime(lua_State *L);
+int bigint_randomprime(lua_State *L);
+int bigint_factorize(lua_State *L);
+int bigint_ecm(lua_State *L);
+int bigint_siqs(lua_State *L);
+int bigint_kernel(lua_State *L);
 
 #endif
@@ -1,6 +1,6 @@
 -- Compute prime factorization of a number, using the bigint library
 --
--- Based on Ray Gardner's work (public domain) from 1985, and 
+-- Originally based on Ray Gardner's work (public domain) from 1985, and 
 -- Thad Smith's work in 1989.
 -- 
 -- Placed in the public domain, Jorj Bauer, 2016.
@@ -11,75 +11,49 @@ local bigint = require "bigint"
 
 local factor = {}
 
+-- Returns the prime factors of n, smallest first and each as many times
+-- as it divides n.  The work is done by bigint.factorize: trial division
+-- by the primes below 1000, then Brent's variant of Pollard's rho, and
+-- the elliptic curve method for factors rho is slow to find.  Pieces of
+-- 30 to 100 digits go to the quadratic sieve once ECM has looked for
+-- small factors.
 function factor.compute(n)
-   local prevfact = bigint:new(0)
    n = bigint:new(n) -- ensure it's a bigint
 
-   local results = {}
+   if (n < bigint:new(2)) then
+      error(n .. " is less than 2")
+   end
 
-   local function show(d,k)
-      prevfact = prevfact + 1
+   return bigint.factorize(n)
+end
 
-      table.insert(results, d)
+-- Looks for one factor of n by the elliptic curve method, running B1
+-- and B2 as the stage 1 and 2 bounds on up to the given number of
+-- curves; the defaults (11000, 100 * B1 and 90) suit factors of about 20
+-- digits.  Returns the factor, which needn't be prime, or nil if none of
+-- the curves found one.
+function factor.ecm(n, B1, B2, curves)
+   n = bigint:new(n) -- ensure it's a bigint
 
-      if (k > bigint:new(1)) then
-	 -- exponentiation: we'll return that as repeating factors
-	 local i=bigint:new(1)
-	 while (i <= k-1) do
-	    table.insert(results, d)
-	    i = i + 1
-	 end
-      end
+   if (n < bigint:new(2)) then
+      error(n .. " is less than 2")
    end
 
-   local d = bigint:new(0)
-   local k = bigint:new(0)
-   
-   prevfact = 0
-   d = n + 1
-   -- check for integer rollover. If we find it, we know the math library can't
-   -- handle math on numbers this large.
-   if (n+bigint:new(3) ~= d+bigint:new(2)) then
-      error(n .. " is too large to process.")
-   end
+   return bigint.ecm(n, B1, B2, curves)
+end
+
+-- Looks for one factor of n with the self-initializing quadratic sieve,
+-- which takes the same time whatever the size of n's factors: moments
+-- at 40 digits, seconds at 55 and minutes from 65.  Returns the factor,
+-- which needn't be prime, or nil if n is prime.
+function factor.siqs(n)
+   n = bigint:new(n) -- ensure it's a bigint
 
    if (n < bigint:new(2)) then
       error(n .. " is less than 2")
-   elseif (n > bigint:new(2)) then
-      d = bigint:new(2)
-      k = bigint:new(0)
-      while (n % d == bigint:new(0)) do
-	 n = n / d
-	 k = k + 1
-      end
-      if (k > bigint:new(0)) then
-	 show(d,k)
-      end
-
-      d = bigint:new(3)
-      while (d * d <= n) do
-	 k=bigint:new(0)
-	 while (n % d == bigint:new(0)) do 
-	    n = n / d
-	    k = k + 1
-	 end
-	 if (k > bigint:new(0)) then
-	    show(d,k)
-	 end
-	 d = d + 2
-      end
-   end
-
-   if (n > bigint:new(1)) then
-      if (prevfact == bigint:new(0)) then
-	 -- It's prime.
-	 return { n }
-      else
-	 show(n,bigint:new(1))
-      end
    end
 
-   return results
+   return bigint.siqs(n)
 end
 
 return factor
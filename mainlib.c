@@ -51,6 +51,14 @@ static const luaL_Reg pointer_meta[] = {
   { "__eq", bigint_equal },
   { "__lt", bigint_lt },
   { "__le", bigint_le },
+#if LUA_VERSION_NUM >= 503
+  { "__band", bigint_band },
+  { "__bor", bigint_bor },
+  { "__bxor", bigint_bxor },
+  { "__bnot", bigint_bnot },
+  { "__shl", bigint_shiftleft },
+  { "__shr", bigint_shiftright },
+#endif
   {NULL,    NULL       }
 };
 
@@ -60,11 +68,41 @@ static const struct luaL_Reg methods[] = {
   { "tonumber",     bigint_tonumber             },
   { "tostring",     bigint_tostring             },
   { "raw",          bigint_raw                  },
+  { "fromraw",      bigint_fromraw              },
+  { "frommpint",    bigint_frommpint            },
+  { "mpint",        bigint_mpint                },
+  { "tobytes",      bigint_tobytes              },
+  { "write",        bigint_write                },
+  { "save",         bigint_save                 },
+  { "load",         bigint_load                 },
   { "expmod",       bigint_expmod               },
+  { "expmod_many",  bigint_expmod_many          },
+  { "divexact",     bigint_divexact             },
   { "inv",          bigint_inv                  },
   { "gcd",          bigint_gcd                  },
   { "shiftleft",    bigint_shiftleft            },
   { "shiftright",   bigint_shiftright           },
+  { "band",         bigint_band                 },
+  { "bor",          bigint_bor                  },
+  { "bxor",         bigint_bxor                 },
+  { "bnot",         bigint_bnot                 },
+  { "testbit",      bigint_testbit              },
+  { "setbit",       bigint_setbit               },
+  { "clearbit",     bigint_clearbit             },
+  { "popcount",     bigint_popcount             },
+  { "ctz",          bigint_ctz                  },
+  { "numbits",      bigint_numbits              },
+  { "isqrt",        bigint_isqrt                },
+  { "iroot",        bigint_iroot                },
+  { "issquare",     bigint_issquare             },
+  { "isperfectpower", bigint_isperfectpower     },
+  { "isprime",      bigint_isprime              },
+  { "nextprime",    bigint_nextprime            },
+  { "randomprime",  bigint_randomprime          },
+  { "factorize",    bigint_factorize            },
+  { "ecm",          bigint_ecm                  },
+  { "siqs",         bigint_siqs                 },
+  { "kernel",       bigint_kernel               },
   { NULL,           NULL                        }
 };
 
@@ -90,6 +90,46 @@ assert(b5:shiftleft(100) == bigint:new("1267650600228229401496703205376"))
 local b7 = b5
 assert(b5:shiftleft(100):shiftright(101) == b7:shiftright(1))
 
+-- Small Lua numbers on the right take the single-word paths, which must
+-- agree with the general ones, signs and carries included
+local big = bigint:new("340282366920938463463374607431768211455") -- 2^128-1
+assert(big + 1 == big + bigint:new(1))
+assert(big + 1 == bigint:new("340282366920938463463374607431768211456"))
+assert(big + 1 - 1 == big)
+assert(-big + 7 == bigint:new(7) - big)
+assert(bigint:new(5) - 7 == bigint:new(-2))
+assert(bigint:new(-5) + 7 == bigint:new(2))
+assert(big * 4000000000 == big * bigint:new("4000000000"))
+assert(big * -3 == -(big * 3))
+assert(big / 1000000007 == big / bigint:new(1000000007))
+assert(big % 1000000007 == big % bigint:new(1000000007))
+assert(-big / 10 == -(big / 10))
+assert(-big % 10 == bigint:new(5))
+assert(big % -10 == bigint:new(-5))
+assert(-(big + 1) % 16 == bigint:new(0))
+assert(-(big + 1) % bigint:new(16) == bigint:new(0))
+assert(big * 1099511627776 == big * bigint:new("1099511627776"))
+assert(big % -1099511627777 == big % bigint:new("-1099511627777"))
+assert(big - 4611686018427387904 == big - bigint:new("4611686018427387904"))
+if _VERSION ~= "Lua 5.1" and _VERSION ~= "Lua 5.2" then
+  assert(bigint:new(0) + 9007199254740993 == bigint:new("9007199254740993"))
+  assert(big - 9223372036854775807 == big - bigint:new("9223372036854775807"))
+  assert(big * -9007199254740993 == big * bigint:new("-9007199254740993"))
+  assert(big % 9007199254740993 == big % bigint:new("9007199254740993"))
+end
+assert(bigint:new("-9223372036854775807") - 1 == bigint:new("-9223372036854775808"))
+assert(bigint:new("-9223372036854775808"):tostring() == "-9223372036854775808")
+
+-- Exact division, with even and multi-limb divisors
+local q = bigint:new("123456789012345678901234567890123456789")
+local dv = bigint:new("98765432109876543210987654321") * 1024
+assert(bigint.divexact(q * dv, dv) == q)
+assert(bigint.divexact(-q * dv, dv) == -q)
+assert(bigint.divexact(q * dv, -dv) == -q)
+assert((q * dv):divexact(q) == dv)
+assert(bigint.divexact(q * 6, 6) == q)
+assert(bigint.divexact(0, dv) == bigint:new(0))
+
 local b6 = bigint:new(2)
 assert(b6:expmod(100, 50) == bigint:new(26)) -- (2^100)%50 == 26
 
@@ -101,10 +141,305 @@ assert(bigint.gcd(45,"330"):tostring() == "15")
 assert(bigint.gcd(258258,48135981) == bigint:new(3))
 assert(bigint.gcd(258258,48135981):tostring() == "3")
 
+-- Every set of arithmetic kernels must agree with the portable ones, on
+-- random operands big enough to reach the vector code
+local function randombig(digits)
+   local s = tostring(math.random(1, 9))
+   for i=2, digits do
+      s = s .. tostring(math.random(0, 9))
+   end
+   return bigint:new(s)
+end
+
+local kernel = bigint.kernel()
+math.randomseed(2026)
+for _,digits in ipairs({ 30, 200, 700, 2000 }) do
+   local k1 = randombig(digits)
+   local k2 = randombig(math.floor(digits * 2 / 3))
+   local ke = randombig(60)
+   local km = randombig(digits) * 2 + 1
+   assert(bigint.kernel("portable"))
+   local kprod, ksquare, kpower = k1 * k2, k1 * k1, k1:expmod(ke, km)
+   assert((k1 + k2) * (k1 - k2) == ksquare - k2 * k2)
+   for _,k in ipairs({ "adx", "avx512ifma", "avx2" }) do
+      if (bigint.kernel(k)) then
+	 assert(k1 * k2 == kprod)
+	 assert(k1 * k1 == ksquare)
+	 assert(k1:expmod(ke, km) == kpower)
+      end
+   end
+end
+
+-- Batched exponentiation must match one-at-a-time, including the
+-- entries (even or unit moduli, zero exponents) it can't vectorize
+local bases, exps, mods = {}, {}, {}
+for i=1, 11 do
+   bases[i] = randombig(10 * i)
+   exps[i] = randombig(5 * i)
+   mods[i] = randombig(20 * i) * 2 + 1
+end
+bases[2] = -bases[2]
+exps[4] = bigint:new(0)
+mods[6] = mods[6] + 1
+mods[9] = bigint:new(1)
+for _,k in ipairs({ "portable", "avx512ifma", "avx2" }) do
+   if (bigint.kernel(k)) then
+      local many = bigint.expmod_many(bases, exps, mods)
+      for i=1, #bases do
+	 assert(many[i] == bases[i]:expmod(exps[i], mods[i]))
+      end
+   end
+end
+assert(#bigint.expmod_many({}, {}, {}) == 0)
+local mixed = bigint.expmod_many({2, "3"}, {10, 5}, {1000, bigint:new(7)})
+assert(mixed[1] == bigint:new(24) and mixed[2] == bigint:new(5))
+assert(not pcall(bigint.expmod_many, {2, 3}, {5, "12x"}, {7, 7}))
+
+-- Strings are parsed in 19-digit chunks, and long ones split in halves;
+-- anything that isn't an optional minus and digits (or 0x and hex) is
+-- an error
+local digits = string.rep("9081726354", 300)
+assert(tostring(bigint:new(digits)) == digits)
+assert(tostring(bigint:new("-000" .. digits)) == "-" .. digits)
+assert(bigint:new("-0") == bigint:new(0))
+assert(tostring(bigint:new("-0")) == "0")
+assert(bigint:new("0x1f") == bigint:new(31))
+for _,s in ipairs({ "", "-", "+1", "12a", "1 2", "0x", "0xfg", digits .. "." }) do
+   assert(not pcall(bigint.new, bigint, s))
+end
+assert(not pcall(function() return b1 + "12345678z" end))
+
+-- Other bases, both ways; power-of-two bases are sliced straight from
+-- the bits, and the rest split like decimal
+assert(bigint:new(255):tostring(16) == "ff")
+assert(bigint:new(-255):tostring(2) == "-11111111")
+assert(bigint:new(0):tostring(36) == "0")
+assert(bigint:new("zz", 36) == bigint:new(1295))
+assert(bigint:new("-FF", 16) == bigint:new(-255))
+assert(bigint:new("0x10") == bigint:new("10", 16))
+local big = bigint:new(digits)
+for _,base in ipairs({ 2, 3, 7, 10, 16, 32, 36 }) do
+   assert(bigint:new(big:tostring(base), base) == big)
+   assert(bigint:new((-big):tostring(base), base) == -big)
+end
+assert(not pcall(bigint.new, bigint, "12", 2))
+assert(not pcall(bigint.new, bigint, "12", 37))
+assert(not pcall(function() return big:tostring(1) end))
+
+-- tostring and raw write straight into the Lua string
+assert(bigint:new(65535):raw() == "\255\255")
+assert(bigint:new(65536):raw() == "\1\0\0")
+assert(#big:raw() == #big:tostring(16) / 2)
+assert(tostring(big) == digits and big:tostring() == digits)
+
+-- Decimal strings are kept on the value after the first conversion
+assert(tostring(big) == digits and "x" .. big == "x" .. digits)
+local keys = { [tostring(big)] = true }
+assert(keys[tostring(big)] and keys[big:tostring(10)])
+assert(tostring(big + 1) ~= digits and tostring(big) == digits)
+
+-- Copies share their digits until one of them changes
+local copy = bigint:new(big)
+assert(copy == big and -copy == -big and tostring(copy) == digits)
+assert(copy:shiftleft(3) == big * 8 and copy + 1 ~= big and copy == big)
+
+-- Binary in and out; the mpints are RFC 4251's examples
+assert(bigint.fromraw("\1\0\0") == bigint:new(65536))
+assert(bigint.fromraw("\255\254") == bigint:new(65534))
+assert(bigint.fromraw("\255\254", true) == bigint:new(-2))
+assert(bigint.fromraw("") == bigint:new(0))
+assert(bigint.fromraw(big:raw()) == big)
+local mpints = {
+   { "0", "\0\0\0\0" },
+   { "0x9a378f9b2e332a7", "\0\0\0\8\9\163\120\249\178\227\50\167" },
+   { "0x80", "\0\0\0\2\0\128" },
+   { "-0x1234", "\0\0\0\2\237\204" },
+   { "-0xdeadbeef", "\0\0\0\5\255\33\82\65\17" },
+}
+for _,m in ipairs(mpints) do
+   assert(bigint:new(m[1]):mpint() == m[2])
+   assert(bigint.frommpint(m[2]) == bigint:new(m[1]))
+end
+assert(not pcall(bigint.frommpint, "\0\0\0\2\1"))
+assert(not pcall(bigint.frommpint, "\0\0"))
+assert(bigint:new(258):tobytes() == "\1\2")
+assert(bigint:new(258):tobytes(4) == "\0\0\1\2")
+assert(bigint:new(258):tobytes(4, "little") == "\2\1\0\0")
+assert(bigint:new(-2):tobytes(2) == "\255\254")
+assert(not pcall(function() return bigint:new(65536):tobytes(2) end))
+for _,n in ipairs({-1, -128, -129, -255, -256, -32768, -32769}) do
+   assert(bigint.fromraw(bigint:new(n):tobytes(), true) == bigint:new(n))
+end
+assert(bigint:new(-128):tobytes() == "\128" and bigint:new(-129):tobytes() == "\255\127")
+assert(not pcall(function() return bigint:new(-129):tobytes(1) end))
+
+-- Streaming decimal output, to a function or a file, in pieces
+local huge = bigint:new(7):shiftleft(500000) - 1
+local pieces = {}
+assert(huge:write(function(s) pieces[#pieces+1] = s end))
+assert(#pieces > 1 and table.concat(pieces) == tostring(huge))
+assert(not huge:write(function(s) return false end))
+assert(not pcall(function() huge:write(function(s) error("stop") end) end))
+pieces = {}
+assert(bigint:new(-3):write(function(s) pieces[#pieces+1] = s end))
+assert(table.concat(pieces) == "-3")
+local name = os.tmpname()
+local fh = io.open(name, "w")
+assert(huge:write(fh))
+fh:write("\n")
+assert(bigint:new(0):write(fh))
+fh:close()
+fh = io.open(name, "r")
+assert(fh:read("l") == tostring(huge) and fh:read("a") == "0")
+fh:close()
+os.remove(name)
+
+-- Binary files; the header is 24 bytes, then little-endian limbs
+assert(huge:save(name))
+assert(bigint.load(name) == huge)
+assert(bigint:new(-5):save(name))
+fh = io.open(name, "rb")
+assert(fh:read("a") == "BIGINT\1\1\8\0\0\0\0\0\0\0\1\0\0\0\0\0\0\0\5\0\0\0\0\0\0\0")
+fh:close()
+assert(bigint.load(name) == bigint:new(-5))
+fh = io.open(name, "wb")
+fh:write("BIGINT\1\0\8\0\0\0\0\0\0\0\2\0\0\0\0\0\0\0\5\0\0\0\0\0\0\0")
+fh:close()
+assert(bigint.load(name) == nil)
+os.remove(name)
+assert(bigint.load(name) == nil)
+
+-- Big enough to go through Karatsuba, the recursive division and the
+-- split decimal output, including runs of zeros across the splits
+for _,digits in ipairs({ 1000, 6000 }) do
+   local n1 = randombig(digits)
+   local n2 = randombig(math.floor(digits / 3))
+   local s = "7" .. string.rep("0", digits) .. "3"
+   assert(tostring(bigint:new(s)) == s)
+   assert(tostring(-bigint:new(s)) == "-" .. s)
+   assert(tostring(bigint:new(tostring(n1))) == tostring(n1))
+   local q, r = n1 / n2, n1 % n2
+   assert(q * n2 + r == n1)
+   assert(r >= bigint:new(0) and r < n2)
+   assert((-n1) / n2 == -q)
+   assert((n1 * n2) / n2 == n1)
+   assert((n1 * n2 + r) % n2 == r)
+end
+assert(bigint.kernel(kernel))
+assert(not bigint.kernel("no-such-kernel"))
+
+-- Fermat's little theorem, on a 2203-bit Mersenne prime
+local m2203 = bigint:new(1):shiftleft(2203) - 1
+assert(bigint:new(3):expmod(m2203 - 1, m2203) == bigint:new(1))
+assert(bigint:new(-3):expmod(m2203, m2203) == m2203 - 3)
+
+-- and on primes of up to four limbs, which take the fixed-width path
+for _, p in ipairs({ bigint:new(1):shiftleft(61) - 1, bigint:new(1):shiftleft(127) - 1,
+		     bigint:new(1):shiftleft(255) - 19 }) do
+   assert(bigint:new(3):expmod(p - 1, p) == bigint:new(1))
+   assert(bigint:new(-5):expmod(p, p) == p - 5)
+end
+assert(b5:shiftleft(64) * b5:shiftleft(64) == bigint:new("340282366920938463463374607431768211456"))
+
+-- Bitwise operations, with negatives as two's complement
+local m12, m10 = bigint:new(-12), bigint:new(10)
+assert(m12:band(m10) == bigint:new(0))
+assert(m12:bor(m10) == bigint:new(-2))
+assert(m12:bxor(m10) == bigint:new(-2))
+assert(m12:bnot() == bigint:new(11))
+assert(m2203:band(bigint:new(1):shiftleft(100) - 1) == bigint:new(1):shiftleft(100) - 1)
+assert(m2203:bxor(m2203):bor(b5) == b5)
+assert(m12:testbit(2) and not m12:testbit(3) and not m12:testbit(1) and m12:testbit(1000))
+assert(m10:setbit(200):clearbit(200) == m10)
+assert(m12:setbit(0) == bigint:new(-11) and m12:clearbit(4) == bigint:new(-28))
+assert(m2203:popcount() == 2203 and m2203:numbits() == 2203)
+assert(bigint:new(0):numbits() == 0 and m12:ctz() == 2 and b5:shiftleft(300):ctz() == 300)
+assert(not math.type or math.type(m12:popcount()) == "integer" and math.type(m12:numbits()) == "integer")
+if _VERSION ~= "Lua 5.1" and _VERSION ~= "Lua 5.2" then
+   local ops = load("local a, b = ... return a & b, a | b, a ~ b, ~a, a << 3, a >> 1, 7 & a")
+   local a, o, x, n, l, r, s = ops(m12, m10)
+   assert(a == bigint:new(0) and o == bigint:new(-2) and x == bigint:new(-2) and n == bigint:new(11))
+   assert(l == bigint:new(-96) and r == bigint:new(-6) and s == bigint:new(4))
+end
+
+-- Roots, small enough for Newton's method and big enough to be split
+local r, rem = bigint.isqrt(bigint:new(99))
+assert(r == bigint:new(9) and rem == bigint:new(18))
+r, rem = bigint.isqrt(bigint:new(0))
+assert(r == bigint:new(0) and rem == bigint:new(0))
+r, rem = m2203:isqrt()
+assert(r * r + rem == m2203 and rem <= r + r)
+r, rem = (m2203 * m2203):isqrt()
+assert(r == m2203 and rem == bigint:new(0))
+assert(bigint:new("1000000000000000000000"):iroot(7) == bigint:new(1000))
+assert(bigint:new(-1000):iroot(3) == bigint:new(-10))
+assert(bigint:new(1):shiftleft(300):iroot(301) == bigint:new(1))
+r = m2203:iroot(5)
+assert(r * r * r * r * r <= m2203 and (r+1) * (r+1) * (r+1) * (r+1) * (r+1) > m2203)
+assert(not pcall(bigint.isqrt, bigint:new(-4)))
+assert(not pcall(bigint.iroot, bigint:new(-4), 2))
+
+-- Perfect squares and powers
+assert(bigint.issquare(m2203 * m2203) and not bigint.issquare(m2203 * m2203 + 1))
+assert(bigint.issquare(0) and not bigint.issquare(-4) and not bigint.issquare(m2203))
+local base, exponent = bigint.isperfectpower(bigint:new(1):shiftleft(60))
+assert(base == bigint:new(2) and exponent == 60)
+base, exponent = bigint.isperfectpower(-(bigint:new(10):expmod(bigint:new(3), m2203) ^ 5))
+assert(base == bigint:new(-10) and exponent == 15)
+base, exponent = (m2203 * m2203 * m2203):isperfectpower()
+assert(base == m2203 and exponent == 3)
+assert(not bigint.isperfectpower(m2203) and not bigint.isperfectpower(1))
+assert(not bigint.isperfectpower(bigint:new(-16)))
+
+-- Primality, including composites that pass one half of BPSW or the
+-- other: 3215031751 and 3825123056546413051 are strong pseudoprimes to
+-- base 2, 5459 is a strong Lucas pseudoprime
+assert(bigint.isprime(2) and bigint.isprime(997) and bigint.isprime(1000003))
+assert(not bigint.isprime(1) and not bigint.isprime(0) and not bigint.isprime(-7))
+assert(not bigint.isprime(1000001) and not bigint.isprime(5459))
+assert(not bigint.isprime(3215031751) and not bigint.isprime("3825123056546413051"))
+assert(m2203:isprime() and m2203:isprime(5))
+assert(not (m2203 * (bigint:new(1):shiftleft(127) - 1)):isprime())
+assert(not (bigint:new(1):shiftleft(2203) + 1):isprime())
+
+-- Prime generation, below the sieve's primes and well above them
+assert(bigint.nextprime(-5) == bigint:new(2) and bigint.nextprime(2) == bigint:new(3))
+assert(bigint.nextprime(1000) == bigint:new(1009))
+assert(bigint.nextprime(bigint:new(1):shiftleft(64)) == bigint:new(1):shiftleft(64) + 13)
+assert(bigint.nextprime(m2203 - 2) == m2203)
+local p = bigint.randomprime(256)
+assert(p:isprime() and p:numbits() == 256 and p:testbit(254))
+assert(bigint.randomprime(2) == bigint:new(3))
+
 assert(arrayMatch(factor.compute(2), { 2 } ))
 assert(arrayMatch(factor.compute(4), { 2, 2 } ))
 assert(arrayMatch(factor.compute(bigint:new(2)), { 2 } ))
 assert(arrayMatch(factor.compute("2"), { 2 } ))
 assert(arrayMatch(factor.compute("99999999999999999999"), { 3, 3, 11, 41, 101, 271, 3541, 9091, 27961 } ))
+assert(arrayMatch(factor.compute("18446744073709551617"), { 274177, "67280421310721" } ))
+assert(arrayMatch(factor.compute(1000003), { 1000003 } ))
+assert(arrayMatch(factor.compute(bigint:new(1009) ^ 3 * 65537 * 65537 * 2), { 2, 1009, 1009, 1009, 65537, 65537 } ))
+assert(arrayMatch(factor.compute(m2203 * 4294967311), { 4294967311, m2203 } ))
+assert(not pcall(factor.compute, 1))
+local f128 = bigint:new(1):shiftleft(128) + 1
+assert(arrayMatch(factor.compute(f128), { "59649589127497217", "5704689200685129054721" } ))
+
+-- ECM finds some factor, not necessarily prime, or none
+local zero = bigint:new(0)
+local f = factor.ecm(f128, 11000, 1100000, 200)
+assert(f > bigint:new(1) and f < f128 and f128 % f == zero)
+local n3 = bigint:new(1000003) * 1000033 * 1000037
+f = bigint.ecm(n3, 500)
+assert(f and f > bigint:new(1) and f < n3 and n3 % f == zero)
+assert(bigint.ecm(2 * 1000003) == bigint:new(2))
+assert(bigint.ecm(1000003) == nil and bigint.ecm(m2203, 100, 0, 1) == nil)
+assert(not pcall(factor.ecm, 1) and not pcall(bigint.ecm, 15, 1))
+
+-- The quadratic sieve, on a 40-digit semiprime
+local s40 = bigint:new("5533137785856946782805032497402845976017")
+f = factor.siqs(s40)
+assert(f == bigint:new("81551467089900298831") or f == bigint:new("67848415035346378207"))
+assert(arrayMatch(factor.compute(s40), { "67848415035346378207", "81551467089900298831" } ))
+assert(bigint.siqs(m2203) == nil and bigint.siqs(1000003 * 65537) and not pcall(factor.siqs, 0))
 
 print("All tests passed")